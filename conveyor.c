@@ -8,8 +8,20 @@
 #include <stdio.h>
 #include <string.h>
 
+// Fields read by conveyor_snapshot() are still only modified under the mutex,
+// but the stores have to be atomic so that the lock-free readers never see a torn value
+#define _CONVEYOR_STORE(field, value) __atomic_store_n(&(field), (value), __ATOMIC_RELAXED)
+#define _CONVEYOR_LOAD(field) __atomic_load_n(&(field), __ATOMIC_RELAXED)
+
+// Event logs can be compiled out for runs at full speed (stress test)
+#ifdef CONVEYOR_NO_LOG
+#define _CONVEYOR_LOG(...) ((void) 0)
+#else
+#define _CONVEYOR_LOG(...) printf(__VA_ARGS__)
+#endif
+
 // Creates a new dynamically allocated conveyor belt structure
-conveyor_t* conveyor_init(size_t max_bricks_count, size_t max_bricks_mass) {
+conveyor_t* conveyor_init(size_t max_bricks_count, size_t max_bricks_mass, dispatch_t* dispatch) {
     conveyor_t* c = malloc(sizeof(conveyor_t));
     if(!c) {
         return NULL;
@@ -21,6 +33,16 @@ conveyor_t* conveyor_init(size_t max_bricks_count, size_t max_bricks_mass) {
     c->bricks_mass = 0;
     c->leftover_brick.mass = 0;
     c->truck_reservation = 0;
+    c->dispatch = dispatch;
+    c->total_inserted_count = 0;
+    c->total_inserted_mass = 0;
+    c->total_removed_count = 0;
+    c->total_removed_mass = 0;
+    c->total_space_waits = 0;
+    c->brick_limit = 0;
+#ifdef CONVEYOR_TRACE_BRICKS
+    c->next_order = 0;
+#endif
 
     // Attributes structures in both cases can be set to NULL
     // According to manual, these functions never encounter errors
@@ -65,40 +87,126 @@ int _conveyor_has_space_for_brick(conveyor_t* c, brick_t b) {
     return (c->bricks_count < c->max_bricks_count) && (c->bricks_mass + b.mass <= c->max_bricks_mass);
 }
 
+// Helper function to check if workers should stop inserting bricks:
+// either they were told to stop, or the limit of bricks for this run was reached
+int _conveyor_is_closed(conveyor_t* c) {
+    return worker_stop_flag_is_set() || (c->brick_limit > 0 && c->total_inserted_count >= c->brick_limit);
+}
+
+// Wakes up every thread waiting on the conveyor, so they can notice the stop flag
+// Caller has to hold the mutex
+void _conveyor_broadcast_all(conveyor_t* c) {
+    pthread_cond_broadcast(&(c->space_freed_cond));
+    pthread_cond_broadcast(&(c->new_brick_cond));
+    pthread_cond_broadcast(&(c->truck_left_cond));
+}
+
+// Stops the production once the last brick allowed for this run was inserted
+// Caller has to hold the mutex (or be the only thread using the conveyor)
+void _conveyor_check_brick_limit(conveyor_t* c) {
+    if(c->brick_limit > 0 && c->total_inserted_count >= c->brick_limit && !worker_stop_flag_is_set()) {
+        _CONVEYOR_LOG("[CONVEYOR]: Limit of %llu bricks reached, stopping production\n", (unsigned long long) c->brick_limit);
+        worker_stop_flag_set();
+    }
+}
+
 // Helper function to check if conveyor is empty
 int _conveyor_is_empty(conveyor_t* c) {
     return c->bricks_count == 0;
 }
 
+// Writes the brick to the pipe and updates the counters
+// Caller has to hold the mutex (or be the only thread using the conveyor) and check for space beforehand
+// Returns 1 if the brick was inserted, 0 in case of error
+int _conveyor_push_brick(conveyor_t* c, brick_t b) {
+#ifdef CONVEYOR_TRACE_BRICKS
+    b.order = c->next_order++;
+#endif
+
+    // Write the 1-byte brick to the pipe, and update the counters
+    ssize_t status_w = write(c->write_fd, (void*) &b, sizeof(brick_t));
+    if(status_w <= 0) {
+        int errno_tmp = errno;
+        fprintf(stderr, "Error while writting to the pipe: %s\n", strerror(errno_tmp));
+        return 0;
+    }
+
+    _CONVEYOR_STORE(c->bricks_count, c->bricks_count + 1);
+    _CONVEYOR_STORE(c->bricks_mass, c->bricks_mass + b.mass);
+    _CONVEYOR_STORE(c->total_inserted_count, c->total_inserted_count + 1);
+    _CONVEYOR_STORE(c->total_inserted_mass, c->total_inserted_mass + b.mass);
+    _CONVEYOR_LOG("[CONVEYOR]: EVENT_INSERT(%d) Current count: %zu, current mass: %zu\n", b.mass, c->bricks_count, c->bricks_mass);
+
+    return 1;
+}
+
+// Removes the next brick from a non-empty conveyor if it fits in available_capacity
+// Caller has to hold the mutex (or be the only thread using the conveyor)
+// Returns brick of mass 0 if the brick is too heavy or in case of error
+brick_t _conveyor_pop_brick(conveyor_t* c, size_t available_capacity) {
+    brick_t empty_brick = { .mass = 0 };
+
+    // If there is no leftover brick, extract one from the pipe
+    if(c->leftover_brick.mass == 0) {
+        ssize_t status_r = read(c->read_fd, (void*) &(c->leftover_brick), sizeof(brick_t));
+        if(status_r < 0) {
+            int errno_tmp = errno;
+            fprintf(stderr, "Error while reading from: %s\n", strerror(errno_tmp));
+            return empty_brick;
+        }
+    }
+
+    // Now check if we have enough weight available to carry the brick - if not, return 0
+    if(c->leftover_brick.mass > available_capacity) {
+        return empty_brick;
+    }
+
+    // If we have enough capacity we should remove the brick, change counters, and return its weight
+    brick_t brick = c->leftover_brick; // Store the brick to return it
+    c->leftover_brick.mass = 0; // Reset leftover brick (remove it from conveyor)
+    _CONVEYOR_STORE(c->bricks_mass, c->bricks_mass - brick.mass);
+    _CONVEYOR_STORE(c->bricks_count, c->bricks_count - 1);
+    _CONVEYOR_STORE(c->total_removed_count, c->total_removed_count + 1);
+    _CONVEYOR_STORE(c->total_removed_mass, c->total_removed_mass + brick.mass);
+
+    _CONVEYOR_LOG("[CONVEYOR]: EVENT_REMOVE(%d) Current count: %zu, current mass: %zu\n", brick.mass, c->bricks_count, c->bricks_mass);
+
+    return brick;
+}
+
 // Used by workers to insert new bricks onto the conveyor
-void conveyor_insert_brick(conveyor_t* c, brick_t b) {
+int conveyor_insert_brick(conveyor_t* c, brick_t b) {
     // First ensure exclusive access to the counters by acquiring the mutex
     pthread_mutex_lock(&(c->mutex));
 
     // If its not possible to fit the brick into the conveyor, wait for a signal
-    // from a truck that space was freed
-    while(!_conveyor_has_space_for_brick(c, b)) {
+    // from a truck that space was freed (or that the production is over)
+    while(!_conveyor_is_closed(c) && !_conveyor_has_space_for_brick(c, b)) {
+        _CONVEYOR_STORE(c->total_space_waits, c->total_space_waits + 1);
         pthread_cond_wait(&(c->space_freed_cond), &(c->mutex));
     }
 
-    // After exiting the loop we have acquired the mutex and are sure there is enough space in the conveyor
-    // Write the 1-byte brick to the pipe, and update the counters
-    ssize_t status_w = write(c->write_fd, (void*) &b, sizeof(brick_t));
-    if(status_w > 0 ){
-        c->bricks_count++;
-        c->bricks_mass += b.mass;
-        printf("[CONVEYOR]: EVENT_INSERT(%d) Current count: %zu, current mass: %zu\n", b.mass, c->bricks_count, c->bricks_mass);
+    if(_conveyor_is_closed(c)) {
+        pthread_mutex_unlock(&(c->mutex));
+        return 0;
     }
-    else{
-        int errno_tmp = errno;
-        fprintf(stderr, "Error while writting to the pipe: %s\n", strerror(errno_tmp));
+
+    // After exiting the loop we have acquired the mutex and are sure there is enough space in the conveyor
+    int inserted = _conveyor_push_brick(c, b);
+
+    // If that was the last brick, trucks waiting for more have to be woken up
+    _conveyor_check_brick_limit(c);
+    if(worker_stop_flag_is_set()) {
+        _conveyor_broadcast_all(c);
     }
-    
+
     // Unlock the mutex for other threads to use
     pthread_mutex_unlock(&(c->mutex));
 
     // Signal that a new brick has arrived on the conveyor
     pthread_cond_signal(&(c->new_brick_cond));
+
+    return inserted;
 }
 
 // Used by trucks to remove last brick from the conveyor, or return information that it is too big otherwise
@@ -114,43 +222,20 @@ brick_t conveyor_remove_brick(conveyor_t* c, size_t available_capacity) {
         if(!worker_stop_flag_is_set()) { // If there is still workers working, wait for new brick
             pthread_cond_wait(&(c->new_brick_cond), &(c->mutex));
         } else { // Otherwise, return empty brick to signify end of bricks
+            _CONVEYOR_LOG("[CONVEYOR]: Current count: %zu, current mass: %zu\n", c->bricks_count, c->bricks_mass);
             pthread_mutex_unlock(&(c->mutex));
-            printf("[CONVEYOR]: Current count: %zu, current mass: %zu\n", c->bricks_count, c->bricks_mass);
             brick_t empty_brick = { .mass = 0 };
             return empty_brick;
         }
     }
 
-    
-    // If there is no leftover brick, extract one from the pipe
-    if(c->leftover_brick.mass == 0) {
-        ssize_t status_r = read(c->read_fd, (void*) &(c->leftover_brick), sizeof(brick_t));
-        if(status_r <0){
-        int errno_tmp = errno;
-        fprintf(stderr, "Error while reading from: %s\n", strerror(errno_tmp));
-        brick_t invalid_brick = { .mass = 0 };
-        return invalid_brick;
-        }
-    }
-
-    // Now check if we have enough weight available to carry the brick - if not, return 0
-    if(c->leftover_brick.mass > available_capacity) {
-        pthread_mutex_unlock(&(c->mutex));
-        brick_t empty_brick = { .mass = 0 };
-        return empty_brick;
-    }
-
-    // If we have enough capacity we should remove the brick, change counters, and return its weight
-    brick_t brick = c->leftover_brick; // Store the brick to return it
-    c->leftover_brick.mass = 0; // Reset leftover brick (remove it from conveyor)
-    c->bricks_mass -= brick.mass;
-    c-> bricks_count -= 1;
+    brick_t brick = _conveyor_pop_brick(c, available_capacity);
 
-    printf("[CONVEYOR]: EVENT_REMOVE(%d) Current count: %zu, current mass: %zu\n", brick.mass, c->bricks_count, c->bricks_mass);
-    
     // do not forget to unlock the mutex and signal that space was freed from the conveyor
     pthread_mutex_unlock(&(c->mutex));
-    pthread_cond_signal(&(c->space_freed_cond));
+    if(brick.mass > 0) {
+        pthread_cond_signal(&(c->space_freed_cond));
+    }
 
     return brick;
 }
@@ -164,20 +249,32 @@ int conveyor_end_of_bricks(conveyor_t* c) {
     return result;
 }
 
+// Gives the free conveyor to the waiting truck chosen by the dispatcher
+// Caller has to hold the mutex, returns id of the chosen truck or 0 if none is waiting
+int _conveyor_grant_next(conveyor_t* c) {
+    int id = dispatch_pick(c->dispatch, c->bricks_mass);
+    _CONVEYOR_STORE(c->truck_reservation, id);
+    return id;
+}
+
 // Function used by trucks to let everyone know they are now using the conveyor
-// (blocks until current truck leaves, if any)
-void conveyor_truck_reserve(conveyor_t* c, int id) {
+// (blocks until the dispatcher chooses this truck)
+void conveyor_truck_reserve(conveyor_t* c, const dispatch_candidate_t* truck) {
     // First ensure exclusive access to the conveyor
     pthread_mutex_lock(&(c->mutex));
 
-    // While there is some other reservation, wait patiently for
-    // the signal that current truck has left
-    while(c->truck_reservation != 0) {
-        pthread_cond_wait(&(c->truck_left_cond), &(c->mutex));
-    };
+    dispatch_enqueue(c->dispatch, truck);
 
-    // Once truck_reservation is empty, we can claim it
-    c->truck_reservation = id;
+    // Wait patiently until the reservation is handed over to us
+    // If nobody holds it, nobody would hand it over - so choose the next truck ourselves
+    while(c->truck_reservation != truck->id) {
+        if(c->truck_reservation == 0) {
+            _conveyor_grant_next(c);
+            pthread_cond_broadcast(&(c->truck_left_cond));
+        } else {
+            pthread_cond_wait(&(c->truck_left_cond), &(c->mutex));
+        }
+    };
 
     // Unlock the mutex afterwards
     pthread_mutex_unlock(&(c->mutex));
@@ -190,12 +287,74 @@ void conveyor_truck_leave(conveyor_t* c, int id) {
 
     // sanity check - only free the reservation, if we had the reservation
     // in the first place
-    if(c->truck_reservation == id)
-        c->truck_reservation = 0;
+    if(c->truck_reservation == id) {
+        // Hand the reservation over and let the waiting trucks know who got it
+        // It has to be a broadcast, as we need to wake up a specific truck
+        if(_conveyor_grant_next(c) != 0) {
+            pthread_cond_broadcast(&(c->truck_left_cond));
+        }
+    }
 
     // Unlock the mutex afterwards
     pthread_mutex_unlock(&(c->mutex));
+}
+
+// Wakes up every waiting worker and truck, used after the stop flag was set
+void conveyor_wake_all(conveyor_t* c) {
+    pthread_mutex_lock(&(c->mutex));
+    _conveyor_broadcast_all(c);
+    pthread_mutex_unlock(&(c->mutex));
+}
+
+// Single-threaded variants - same logic as above, but without the mutex and without waiting
+
+int conveyor_try_insert_brick_unlocked(conveyor_t* c, brick_t b) {
+    if(_conveyor_is_closed(c) || !_conveyor_has_space_for_brick(c, b)) {
+        return 0;
+    }
+
+    int inserted = _conveyor_push_brick(c, b);
+    _conveyor_check_brick_limit(c);
+    return inserted;
+}
+
+brick_t conveyor_try_remove_brick_unlocked(conveyor_t* c, size_t available_capacity) {
+    if(_conveyor_is_empty(c)) {
+        brick_t empty_brick = { .mass = 0 };
+        return empty_brick;
+    }
+
+    return _conveyor_pop_brick(c, available_capacity);
+}
+
+void conveyor_truck_request_unlocked(conveyor_t* c, const dispatch_candidate_t* truck) {
+    dispatch_enqueue(c->dispatch, truck);
+}
+
+int conveyor_truck_dispatch_unlocked(conveyor_t* c) {
+    if(c->truck_reservation != 0) {
+        return 0;
+    }
+
+    return _conveyor_grant_next(c);
+}
+
+void conveyor_truck_leave_unlocked(conveyor_t* c, int id) {
+    // sanity check - only free the reservation, if we had the reservation
+    // in the first place
+    if(c->truck_reservation == id)
+        _CONVEYOR_STORE(c->truck_reservation, 0);
+}
 
-    // Let other trucks know that we left the conveyor
-    pthread_cond_signal(&(c->truck_left_cond));
+// Reads the counters without the mutex - every field is loaded atomically on its own,
+// so a producer or truck can move between two loads, but no value is ever torn
+void conveyor_snapshot(conveyor_t* c, conveyor_snapshot_t* s) {
+    s->bricks_count = _CONVEYOR_LOAD(c->bricks_count);
+    s->bricks_mass = _CONVEYOR_LOAD(c->bricks_mass);
+    s->truck_reservation = _CONVEYOR_LOAD(c->truck_reservation);
+    s->total_inserted_count = _CONVEYOR_LOAD(c->total_inserted_count);
+    s->total_inserted_mass = _CONVEYOR_LOAD(c->total_inserted_mass);
+    s->total_removed_count = _CONVEYOR_LOAD(c->total_removed_count);
+    s->total_removed_mass = _CONVEYOR_LOAD(c->total_removed_mass);
+    s->total_space_waits = _CONVEYOR_LOAD(c->total_space_waits);
 }
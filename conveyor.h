@@ -5,9 +5,18 @@
 #include <stdint.h>
 #include <pthread.h>
 
+#include "dispatch.h"
+
 // A brick only contains info about its mass
+// With CONVEYOR_TRACE_BRICKS defined (stress test build) bricks also carry sequence numbers,
+// so that the order in which they leave the conveyor can be checked
 struct brick_t {
     uint8_t mass;
+#ifdef CONVEYOR_TRACE_BRICKS
+    uint16_t producer; // Set by the producer
+    uint32_t producer_seq; // Set by the producer, consecutive for each producer
+    uint32_t order; // Set by the conveyor on insertion, consecutive for the whole conveyor
+#endif
 };
 typedef struct brick_t brick_t;
 
@@ -30,6 +39,30 @@ struct conveyor_t {
     // Equal to 0 if conveyor is not loading any truck at the moment
     int truck_reservation;
 
+    // Decides which of the waiting trucks gets the reservation once it is freed
+    // Not owned by the conveyor, protected by the mutex
+    dispatch_t* dispatch;
+
+    // Throughput counters, only ever growing
+    // Like the counters above they are written under the mutex, but with relaxed atomic stores,
+    // so that conveyor_snapshot() can read them without taking the mutex
+    uint64_t total_inserted_count;
+    uint64_t total_inserted_mass;
+    uint64_t total_removed_count;
+    uint64_t total_removed_mass;
+
+    // Number of times a worker had to wait for space on the conveyor
+    uint64_t total_space_waits;
+
+    // Maximum number of bricks inserted during the run, 0 if unlimited
+    // Once reached, the conveyor sets the worker stop flag - set it after conveyor_init(), before the run
+    uint64_t brick_limit;
+
+#ifdef CONVEYOR_TRACE_BRICKS
+    // Order given to the next inserted brick
+    uint32_t next_order;
+#endif
+
     // Because access to counters has to be atomic, synchronization primitives are necessary
     pthread_cond_t space_freed_cond; // Conditional signaled by trucks when they remove a brick and free some space in this way
     pthread_cond_t new_brick_cond; // Conditional signaled by workers when they insert a new brick into conveyor
@@ -42,14 +75,33 @@ struct conveyor_t {
 };
 typedef struct conveyor_t conveyor_t;
 
+// Point-in-time view of the conveyor counters, used for monitoring
+// Fields are read one by one, so they are not guaranteed to be consistent with each other
+struct conveyor_snapshot_t {
+    size_t bricks_count;
+    size_t bricks_mass;
+    int truck_reservation;
+    uint64_t total_inserted_count;
+    uint64_t total_inserted_mass;
+    uint64_t total_removed_count;
+    uint64_t total_removed_mass;
+
+    // Number of times a worker had to wait for space on the conveyor
+    uint64_t total_space_waits;
+};
+typedef struct conveyor_snapshot_t conveyor_snapshot_t;
+
 // Creates a new dynamically allocated conveyor belt structure
-conveyor_t* conveyor_init(size_t max_bricks_count, size_t max_bricks_mass);
+// The dispatcher has to outlive the conveyor
+conveyor_t* conveyor_init(size_t max_bricks_count, size_t max_bricks_mass, dispatch_t* dispatch);
 
 // Proper cleanup of conveyor belt structure, closing the pipe etc
 void conveyor_destroy(conveyor_t*);
 
-// Used by workers to insert bricks
-void conveyor_insert_brick(conveyor_t*, brick_t);
+// Used by workers to insert bricks, blocks until there is space for the brick
+// Returns 1 if the brick was inserted, 0 if the production is over (worker_stop_flag_is_set()
+// or brick_limit reached) or in case of error
+int conveyor_insert_brick(conveyor_t*, brick_t);
 
 // Used by trucks to load a brick from the conveyor
 // Returns size of brick if succesful
@@ -61,12 +113,42 @@ brick_t conveyor_remove_brick(conveyor_t*, size_t);
 int conveyor_end_of_bricks(conveyor_t*);
 
 // Function used by trucks to let everyone know they are now using the conveyor
-// (blocks until current truck leaves, if any)
-// second argument is truck id
-void conveyor_truck_reserve(conveyor_t*, int);
+// (blocks until the dispatcher chooses this truck among the waiting ones)
+// second argument describes the truck
+void conveyor_truck_reserve(conveyor_t*, const dispatch_candidate_t*);
 
 // Function used by trucks to let everyone know they are leaving the conveyor
 // second argument is truck id - used for checking if we have the truck reserved
+// The reservation is handed over to the next truck chosen by the dispatcher
 void conveyor_truck_leave(conveyor_t*, int);
 
+// Wakes up all workers and trucks waiting on the conveyor
+// Has to be called after setting the worker stop flag, otherwise a truck waiting for new bricks would wait forever
+void conveyor_wake_all(conveyor_t*);
+
+// Non-blocking variants of the functions above which do NOT take the mutex
+// Only to be used when a single thread drives the whole conveyor (see engine module)
+
+// Inserts the brick if there is space for it, returns 1 if it was inserted
+int conveyor_try_insert_brick_unlocked(conveyor_t*, brick_t);
+
+// Removes the next brick if there is one and it fits in the capacity
+// Returns brick of size 0 otherwise
+brick_t conveyor_try_remove_brick_unlocked(conveyor_t*, size_t);
+
+// Adds the truck to the ones waiting for the conveyor
+void conveyor_truck_request_unlocked(conveyor_t*, const dispatch_candidate_t*);
+
+// If the conveyor is free, reserves it for the waiting truck chosen by the dispatcher
+// Returns id of that truck, or 0 if the conveyor is taken or no truck is waiting
+int conveyor_truck_dispatch_unlocked(conveyor_t*);
+
+// Frees the reservation held by the truck with given id
+// Unlike conveyor_truck_leave(), does not hand it over - call conveyor_truck_dispatch_unlocked() for that
+void conveyor_truck_leave_unlocked(conveyor_t*, int);
+
+// Reads the counters of the conveyor WITHOUT taking the mutex
+// Safe to call from any thread at any rate, meant for samplers and statistics
+void conveyor_snapshot(conveyor_t*, conveyor_snapshot_t*);
+
 #endif
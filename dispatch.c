@@ -0,0 +1,121 @@
+#include "dispatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+dispatch_t* dispatch_init(dispatch_policy_t policy, size_t max_waiting) {
+    dispatch_t* d = malloc(sizeof(dispatch_t));
+    if(!d) {
+        return NULL;
+    }
+
+    d->waiting = malloc(max_waiting * sizeof(dispatch_candidate_t));
+    if(!d->waiting) {
+        free(d);
+        return NULL;
+    }
+
+    d->policy = policy;
+    d->waiting_count = 0;
+    d->max_waiting = max_waiting;
+    d->grants = 0;
+    d->contested_grants = 0;
+    d->total_wait_ms = 0;
+    d->max_wait_ms = 0;
+
+    return d;
+}
+
+void dispatch_destroy(dispatch_t* d) {
+    free(d->waiting);
+    free(d);
+}
+
+int dispatch_parse_policy(const char* name, dispatch_policy_t* policy) {
+    if(strcmp(name, "fifo") == 0) {
+        *policy = DISPATCH_FIFO;
+    } else if(strcmp(name, "mass") == 0) {
+        *policy = DISPATCH_MASS_RATE;
+    } else {
+        return 1;
+    }
+
+    return 0;
+}
+
+void dispatch_enqueue(dispatch_t* d, const dispatch_candidate_t* candidate) {
+    // Sanity check - every truck waits at most once at a time
+    if(d->waiting_count == d->max_waiting) {
+        fprintf(stderr, "Error - truck %d does not fit in the dispatcher queue\n", candidate->id);
+        return;
+    }
+
+    dispatch_candidate_t* slot = &(d->waiting[d->waiting_count++]);
+    *slot = *candidate;
+    clock_gettime(CLOCK_MONOTONIC, &(slot->arrival));
+}
+
+// Mass per second the truck could take away right now, scaled to avoid floating point
+// Capacities are small enough for the multiplication not to overflow
+size_t _dispatch_mass_rate(const dispatch_candidate_t* candidate, size_t belt_mass) {
+    size_t load = candidate->capacity < belt_mass ? candidate->capacity : belt_mass;
+    return load * 1000 / candidate->delivery_time;
+}
+
+// Index of the waiting truck chosen by the policy
+size_t _dispatch_choose(dispatch_t* d, size_t belt_mass) {
+    size_t chosen = 0;
+
+    if(d->policy == DISPATCH_MASS_RATE) {
+        size_t best_rate = _dispatch_mass_rate(&(d->waiting[0]), belt_mass);
+
+        // Strict comparison keeps the earliest truck among equally good ones
+        for(size_t i = 1; i < d->waiting_count; i++) {
+            size_t rate = _dispatch_mass_rate(&(d->waiting[i]), belt_mass);
+            if(rate > best_rate) {
+                best_rate = rate;
+                chosen = i;
+            }
+        }
+    }
+
+    return chosen;
+}
+
+int dispatch_pick(dispatch_t* d, size_t belt_mass) {
+    if(d->waiting_count == 0) {
+        return 0;
+    }
+
+    size_t chosen = _dispatch_choose(d, belt_mass);
+    dispatch_candidate_t candidate = d->waiting[chosen];
+
+    // Remove the truck keeping the order of arrival of the others
+    memmove(&(d->waiting[chosen]), &(d->waiting[chosen + 1]), (d->waiting_count - chosen - 1) * sizeof(dispatch_candidate_t));
+    d->waiting_count--;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t wait_ms = (now.tv_sec - candidate.arrival.tv_sec) * 1000 + (now.tv_nsec - candidate.arrival.tv_nsec) / 1000000;
+
+    d->grants++;
+    if(d->waiting_count > 0) {
+        d->contested_grants++;
+    }
+    d->total_wait_ms += wait_ms;
+    if(wait_ms > d->max_wait_ms) {
+        d->max_wait_ms = wait_ms;
+    }
+
+    return candidate.id;
+}
+
+void dispatch_print_stats(dispatch_t* d) {
+    printf("[DISPATCH] policy: %s, grants: %llu (contested: %llu), truck wait time avg: %llums, max: %llums\n",
+        d->policy == DISPATCH_FIFO ? "fifo" : "mass",
+        (unsigned long long) d->grants,
+        (unsigned long long) d->contested_grants,
+        (unsigned long long) (d->grants > 0 ? d->total_wait_ms / d->grants : 0),
+        (unsigned long long) d->max_wait_ms);
+}
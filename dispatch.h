@@ -0,0 +1,66 @@
+#ifndef _DISPATCH_H_
+#define _DISPATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Policy used to choose which of the waiting trucks gets the conveyor next
+enum dispatch_policy_t {
+    // Truck which has been waiting the longest
+    DISPATCH_FIFO,
+    // Truck which can take the most mass per second of delivery: min(capacity, belt mass) / delivery time
+    // Ties (e.g. empty belt) are resolved like in DISPATCH_FIFO
+    DISPATCH_MASS_RATE,
+};
+typedef enum dispatch_policy_t dispatch_policy_t;
+
+// A truck waiting for the conveyor
+struct dispatch_candidate_t {
+    int id;
+    size_t capacity;
+    unsigned int delivery_time;
+
+    // Time when the truck started waiting, filled in by dispatch_enqueue()
+    struct timespec arrival;
+};
+typedef struct dispatch_candidate_t dispatch_candidate_t;
+
+// Dispatcher is NOT synchronized - it is protected by the conveyor mutex
+// (or used from a single thread in the event loop runtime)
+struct dispatch_t {
+    dispatch_policy_t policy;
+
+    // Waiting trucks, in order of arrival
+    dispatch_candidate_t* waiting;
+    size_t waiting_count;
+    size_t max_waiting;
+
+    // Statistics used to compare the policies
+    uint64_t grants; // Number of times the conveyor was given to a truck
+    uint64_t contested_grants; // Grants where more than one truck was waiting
+    uint64_t total_wait_ms; // Time spent by trucks waiting for the conveyor
+    uint64_t max_wait_ms;
+};
+typedef struct dispatch_t dispatch_t;
+
+// Creates a new dispatcher for at most max_waiting trucks, returns NULL in case of error
+dispatch_t* dispatch_init(dispatch_policy_t, size_t);
+
+void dispatch_destroy(dispatch_t*);
+
+// Parses the policy name ("fifo" or "mass"), returns 0 if it succeeds
+int dispatch_parse_policy(const char*, dispatch_policy_t*);
+
+// Adds a truck to the waiting trucks
+void dispatch_enqueue(dispatch_t*, const dispatch_candidate_t*);
+
+// Removes the truck chosen by the policy from the waiting trucks and returns its id
+// Second argument is the mass currently on the conveyor
+// Returns 0 if no truck is waiting
+int dispatch_pick(dispatch_t*, size_t);
+
+// Prints the statistics gathered so far
+void dispatch_print_stats(dispatch_t*);
+
+#endif
@@ -0,0 +1,327 @@
+#include "engine.h"
+
+#include "worker.h"
+#include "truck.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+// epoll user data of the signalfd and of the run time limit, trucks are identified by their index
+#define ENGINE_SIGNAL_EVENT UINT32_MAX
+#define ENGINE_DEADLINE_EVENT (UINT32_MAX - 1)
+
+#define ENGINE_MAX_EVENTS 16
+
+// State of the whole yard, only ever touched by the thread running the loop
+struct engine_t {
+    conveyor_t* conveyor;
+
+    worker_t* workers[SIM_MAX_WORKERS];
+    size_t worker_count;
+
+    // Truck with given id is stored under index id - 1
+    // Trucks waiting for the conveyor are kept by the dispatcher of the conveyor
+    truck_t** trucks;
+    int* timer_fds; // One timerfd per truck, armed while the truck is delivering
+    size_t truck_count;
+
+    // Index of the truck being loaded, -1 if the conveyor is free
+    long docked;
+
+    // Number of trucks which are still running (not finished because of end of bricks)
+    size_t active_trucks;
+
+    int epoll_fd;
+    int signal_fd;
+    int deadline_fd; // timerfd for the run time limit, -1 if unlimited
+};
+typedef struct engine_t engine_t;
+
+// Puts the truck in the queue for the conveyor
+void _engine_truck_request(engine_t* e, truck_t* t) {
+    dispatch_candidate_t candidate;
+    truck_fill_candidate(t, &candidate);
+    conveyor_truck_request_unlocked(e->conveyor, &candidate);
+}
+
+// Same condition as conveyor_end_of_bricks(), without the mutex
+int _engine_end_of_bricks(engine_t* e) {
+    return e->conveyor->bricks_count == 0 && worker_stop_flag_is_set();
+}
+
+// Worker callback - tries to put a single brick on the conveyor, returns 1 if it did
+int _engine_worker_step(engine_t* e, worker_t* w) {
+    brick_t new_brick = { .mass = w->produced_brick_weight };
+
+    if(!conveyor_try_insert_brick_unlocked(e->conveyor, new_brick)) {
+        return 0;
+    }
+
+    printf("[P%d] EVENT_WORKER_INSERT(%d) Succesfully inserted brick of weight %zu into the conveyor\n", w->id, w->id, w->produced_brick_weight);
+    return 1;
+}
+
+void _engine_truck_finish(engine_t* e, truck_t* t) {
+    printf("[C%d] Truck finishing work, due to no more bricks\n", t->id);
+    truck_print_stats(t);
+    e->active_trucks--;
+}
+
+// Truck callback - docks the next waiting truck if the conveyor is free and loads it
+// for as long as there are bricks that fit, returns 1 if anything happened
+int _engine_truck_step(engine_t* e) {
+    int progress = 0;
+
+    while(1) {
+        if(e->docked < 0) {
+            int id = conveyor_truck_dispatch_unlocked(e->conveyor);
+            if(id == 0) {
+                return progress;
+            }
+
+            truck_t* t = e->trucks[id - 1];
+            progress = 1;
+
+            // Trucks do not load once there will be no more bricks
+            if(_engine_end_of_bricks(e)) {
+                conveyor_truck_leave_unlocked(e->conveyor, id);
+                _engine_truck_finish(e, t);
+                continue;
+            }
+
+            e->docked = id - 1;
+            printf("[C%d] Truck reserved the conveyor access - loading\n", t->id);
+        }
+
+        truck_t* t = e->trucks[e->docked];
+        brick_t new_brick = conveyor_try_remove_brick_unlocked(e->conveyor, t->current_capacity);
+
+        if(new_brick.mass > 0) {
+            t->current_capacity -= new_brick.mass;
+            printf("[C%d] EVENT_TRUCK_REMOVAL(%d,%zu) Truck received a brick of mass %zu - capacity: %zu/%zu\n", t->id, t->id, (size_t) new_brick.mass, (size_t) new_brick.mass, t->current_capacity, t->max_capacity);
+            progress = 1;
+            continue;
+        }
+
+        // Empty conveyor - the truck keeps waiting at the dock for new bricks, unless there will be none
+        if(e->conveyor->bricks_count == 0 && !worker_stop_flag_is_set()) {
+            return progress;
+        }
+
+        // Next brick does not fit or no more bricks - leave and deliver
+        printf("[C%d] Truck full - leaving\n", t->id);
+        conveyor_truck_leave_unlocked(e->conveyor, t->id);
+        truck_deliver(t);
+
+        struct itimerspec delivery = { .it_value = { .tv_sec = t->sleep_time } };
+        if(timerfd_settime(e->timer_fds[e->docked], 0, &delivery, NULL) != 0) {
+            int errno_tmp = errno;
+            fprintf(stderr, "Error arming delivery timer: %s\n", strerror(errno_tmp));
+        }
+
+        e->docked = -1;
+        progress = 1;
+    }
+}
+
+// Handles a single epoll event, returns 0 in case of error
+int _engine_handle_event(engine_t* e, uint32_t source) {
+    if(source == ENGINE_SIGNAL_EVENT) {
+        struct signalfd_siginfo info;
+        if(read(e->signal_fd, &info, sizeof(info)) != sizeof(info)) {
+            return errno == EAGAIN;
+        }
+
+        // SIGUSR2 tells workers to stop
+        if(info.ssi_signo == SIGUSR2) {
+            worker_stop_flag_set();
+        }
+        return 1;
+    }
+
+    if(source == ENGINE_DEADLINE_EVENT) {
+        uint64_t expirations;
+        if(read(e->deadline_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            return errno == EAGAIN;
+        }
+
+        printf("[Main] Time limit reached, stopping production\n");
+        worker_stop_flag_set();
+        return 1;
+    }
+
+    // Truck came back from the delivery
+    uint64_t expirations;
+    if(read(e->timer_fds[source], &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return errno == EAGAIN;
+    }
+
+    truck_t* t = e->trucks[source];
+
+    if(_engine_end_of_bricks(e)) {
+        _engine_truck_finish(e, t);
+    } else {
+        _engine_truck_request(e, t);
+    }
+
+    return 1;
+}
+
+// Event loop, returns 0 in case of error
+int _engine_loop(engine_t* e) {
+    struct epoll_event events[ENGINE_MAX_EVENTS];
+
+    while(e->active_trucks > 0) {
+        int progress = 0;
+
+        // Let the workers fill the conveyor one brick each, until none of them fits
+        int inserted = 1;
+        while(inserted && !worker_stop_flag_is_set()) {
+            inserted = 0;
+            for(size_t i = 0; i < e->worker_count; i++) {
+                inserted |= _engine_worker_step(e, e->workers[i]);
+            }
+            progress |= inserted;
+        }
+
+        progress |= _engine_truck_step(e);
+
+        if(e->active_trucks == 0) {
+            break;
+        }
+
+        // Only sleep when nothing can move until a truck returns or a signal arrives
+        int n = epoll_wait(e->epoll_fd, events, ENGINE_MAX_EVENTS, progress ? 0 : -1);
+        if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            int errno_tmp = errno;
+            fprintf(stderr, "Error in epoll_wait(): %s\n", strerror(errno_tmp));
+            return 0;
+        }
+
+        for(int i = 0; i < n; i++) {
+            if(!_engine_handle_event(e, events[i].data.u32)) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+// Registers the fd in epoll, returns 0 in case of error
+int _engine_watch(engine_t* e, int fd, uint32_t source) {
+    struct epoll_event event = { .events = EPOLLIN, .data = { .u32 = source } };
+    return epoll_ctl(e->epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+int engine_run(conveyor_t* c, const sim_params_t* params) {
+    size_t truck_count = params->truck_count;
+    truck_t* trucks[truck_count];
+    int timer_fds[truck_count];
+
+    engine_t e = {
+        .conveyor = c,
+        .trucks = trucks,
+        .timer_fds = timer_fds,
+        .truck_count = truck_count,
+        .docked = -1,
+        .active_trucks = truck_count,
+        .worker_count = params->worker_count,
+        .epoll_fd = -1,
+        .signal_fd = -1,
+        .deadline_fd = -1,
+    };
+
+    for(size_t i = 0; i < SIM_MAX_WORKERS; i++) {
+        e.workers[i] = NULL;
+    }
+    for(size_t i = 0; i < truck_count; i++) {
+        trucks[i] = NULL;
+        timer_fds[i] = -1;
+    }
+
+    int ok = 1;
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGUSR2);
+
+    e.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    e.signal_fd = signalfd(-1, &set, SFD_NONBLOCK | SFD_CLOEXEC);
+    if(e.epoll_fd < 0 || e.signal_fd < 0 || !_engine_watch(&e, e.signal_fd, ENGINE_SIGNAL_EVENT)) {
+        int errno_tmp = errno;
+        fprintf(stderr, "Error setting up the event loop: %s\n", strerror(errno_tmp));
+        ok = 0;
+    }
+
+    if(ok && params->stop_after_seconds > 0) {
+        struct itimerspec limit = { .it_value = { .tv_sec = params->stop_after_seconds } };
+        e.deadline_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+        if(e.deadline_fd < 0 || timerfd_settime(e.deadline_fd, 0, &limit, NULL) != 0 || !_engine_watch(&e, e.deadline_fd, ENGINE_DEADLINE_EVENT)) {
+            int errno_tmp = errno;
+            fprintf(stderr, "Error setting up the time limit: %s\n", strerror(errno_tmp));
+            ok = 0;
+        }
+    }
+
+    for(size_t i = 0; ok && i < e.worker_count; i++) {
+        e.workers[i] = worker_init(i + 1, params->worker_weights[i], c);
+
+        if(e.workers[i] == NULL) {
+            printf("Error while creating worker with id %zu\n", i + 1);
+            ok = 0;
+        } else {
+            printf("[P%zu] Worker started with data: { weight: %zu, conveyor reference: %p }\n", i + 1, e.workers[i]->produced_brick_weight, (void*) c);
+        }
+    }
+
+    for(size_t i = 0; ok && i < truck_count; i++) {
+        trucks[i] = truck_init(i + 1, params->fleet[i].capacity, params->fleet[i].sleep_time, c);
+        timer_fds[i] = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+        if(trucks[i] == NULL || timer_fds[i] < 0 || !_engine_watch(&e, timer_fds[i], (uint32_t) i)) {
+            printf("Error while creating truck with id %zu\n", i + 1);
+            ok = 0;
+        } else {
+            printf("[C%d] EVENT_TRUCK_START(%d) with data: { max_capacity: %zu, sleep_time: %ds, conveyor reference: %p }\n", trucks[i]->id, trucks[i]->id, trucks[i]->max_capacity, trucks[i]->sleep_time, (void*) c);
+            _engine_truck_request(&e, trucks[i]);
+        }
+    }
+
+    if(ok) {
+        ok = _engine_loop(&e);
+    }
+
+    for(size_t i = 0; i < truck_count; i++) {
+        if(timer_fds[i] >= 0) {
+            close(timer_fds[i]);
+        }
+        free(trucks[i]);
+    }
+    for(size_t i = 0; i < e.worker_count; i++) {
+        free(e.workers[i]);
+    }
+    if(e.deadline_fd >= 0) {
+        close(e.deadline_fd);
+    }
+    if(e.signal_fd >= 0) {
+        close(e.signal_fd);
+    }
+    if(e.epoll_fd >= 0) {
+        close(e.epoll_fd);
+    }
+
+    return ok;
+}
@@ -0,0 +1,14 @@
+#ifndef _ENGINE_H_
+#define _ENGINE_H_
+
+#include "conveyor.h"
+#include "sim.h"
+
+// Alternative runtime which runs the whole simulation in the calling thread
+// Workers and trucks are callbacks driven by an epoll loop, truck deliveries are timerfds
+// and the conveyor is used through its unlocked API
+// SIGUSR2 has to be blocked by the caller, it is received through a signalfd
+// Returns 0 in case of error
+int engine_run(conveyor_t*, const sim_params_t*);
+
+#endif
@@ -2,105 +2,267 @@
 #include "worker.h"
 #include "truck.h"
 #include "sim.h"
+#include "sampler.h"
+#include "engine.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <signal.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
 
+// How often main thread checks whether the production stopped on its own (brick limit reached)
+#define MAIN_POLL_INTERVAL_MS 100
 
-// SIGUSR2 tells workers to stop
-void _usr2_handler(int a) {
-    worker_stop_flag_set();
-}
+// Waits until the production should stop: SIGUSR2 was received, the time limit passed,
+// or the conveyor reached the brick limit and set the stop flag itself
+// SIGUSR2 has to be blocked, it is received with sigtimedwait()
+void _wait_for_stop(sim_params_t* params, sigset_t* usr2_set) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += params->stop_after_seconds;
 
-struct sigaction usr2_sigaction = {
-    .sa_handler = &_usr2_handler
-};
+    while(!worker_stop_flag_is_set()) {
+        struct timespec timeout = { .tv_sec = 0, .tv_nsec = MAIN_POLL_INTERVAL_MS * 1000000L };
 
-int main() {
-    sim_params_t params = { 0 };
-    sim_query_user_for_params(&params);
+        if(params->stop_after_seconds > 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long long left_ns = (deadline.tv_sec - now.tv_sec) * 1000000000LL + (deadline.tv_nsec - now.tv_nsec);
 
-    conveyor_t* conveyor = conveyor_init(params.max_bricks_count, params.max_bricks_mass);
+            if(left_ns <= 0) {
+                printf("[Main] Time limit of %us reached, stopping production\n", params->stop_after_seconds);
+                break;
+            }
+            if(left_ns < timeout.tv_nsec) {
+                timeout.tv_nsec = left_ns;
+            }
+        }
 
-    if(!conveyor) {
-        puts("Error while creating conveyor");
-        exit(0);
+        if(sigtimedwait(usr2_set, NULL, &timeout) == SIGUSR2) {
+            break;
+        }
     }
 
+    // SIGUSR2 tells workers to stop
+    worker_stop_flag_set();
+}
+
+// Thread-per-entity runtime: each worker and each truck is a separate thread,
+// main thread only waits for the end of production
+// Rate controller is optional (NULL)
+sim_status_t _run_threads(conveyor_t* conveyor, sim_params_t* params, ratectl_t* rate_control) {
     // Block all signals prior to creating worker threads, as htey will inherit the signal mask
     // And we only want to receive signals in the main thread
     sigset_t set;
     sigfillset(&set); // select all signals (fill the set)
     int result = pthread_sigmask(SIG_BLOCK, &set, NULL); // Set all signals to block
     if(result != 0) {
-        conveyor_destroy(conveyor);
         puts("Error while  setting sigmask");
-        exit(0);
+        return SIM_ERROR_RUNTIME;
     };
 
-    worker_t* workers[SIM_NUM_WORKERS];
-    for(int i = 0; i < SIM_NUM_WORKERS; i++) {
-        workers[i] = worker_init(i + 1, i + 1, conveyor);
+    worker_t* workers[params->worker_count];
+    for(size_t i = 0; i < params->worker_count; i++) {
+        workers[i] = worker_init(i + 1, params->worker_weights[i], conveyor);
 
         if(workers[i] == NULL) {
-            printf("Error while creating worker with id %d\n", i + 1);
-            exit(0);
+            printf("Error while creating worker with id %zu\n", i + 1);
+            return SIM_ERROR_RUNTIME;
         }
+
+        workers[i]->rate_control = rate_control;
     };
 
-    for(int i = 0; i < SIM_NUM_WORKERS; i++) {
+    for(size_t i = 0; i < params->worker_count; i++) {
         int result = worker_start(workers[i]);
 
         if(result == 0) {
             printf("Error while starting worker with id %d\n", workers[i]->id);
-            exit(0);
+            return SIM_ERROR_RUNTIME;
         };
     };
 
-    truck_t* trucks[params.truck_count];
-    for(size_t i = 0; i < params.truck_count; i++) {
-        trucks[i] = truck_init(i + 1, params.truck_capacity, params.truck_sleep_time, conveyor);
+    truck_t* trucks[params->truck_count];
+    for(size_t i = 0; i < params->truck_count; i++) {
+        trucks[i] = truck_init(i + 1, params->fleet[i].capacity, params->fleet[i].sleep_time, conveyor);
 
         if(trucks[i] == NULL) {
             printf("Error while creating truck with id %lu\n", i + 1);
-            exit(0);
+            return SIM_ERROR_RUNTIME;
         }
     };
 
-    for(size_t i = 0; i < params.truck_count; i++) {
+    for(size_t i = 0; i < params->truck_count; i++) {
         int result = truck_start(trucks[i]);
 
         if(result == 0) {
             printf("Error while starting truck with id %d\n", trucks[i]->id);
-            exit(0);
+            return SIM_ERROR_RUNTIME;
         };
     };
 
-    result = sigaction(SIGUSR2, &usr2_sigaction, NULL);
-    if(result != 0) {
-        puts("Error installing SIGUSR2 handler");
-        exit(0);
-    };
-
-    // Unblock the signals after creating workers and installing signal handlers
-    result = pthread_sigmask(SIG_UNBLOCK, &set, NULL); // Set all signals to unblock
+    // Unblock the signals after creating workers, except SIGUSR2 which is waited for below
+    sigdelset(&set, SIGUSR2);
+    result = pthread_sigmask(SIG_UNBLOCK, &set, NULL);
     if(result != 0) {
         puts("Error while unblocking signals in main");
-        exit(0);
+        return SIM_ERROR_RUNTIME;
     };
 
+    sigset_t usr2_set;
+    sigemptyset(&usr2_set);
+    sigaddset(&usr2_set, SIGUSR2);
+    _wait_for_stop(params, &usr2_set);
+    if(rate_control) {
+        ratectl_stop(rate_control);
+    }
+
+    // Trucks waiting for bricks that will never come have to be woken up
+    conveyor_wake_all(conveyor);
+
     // Join threads
-    for(int i = 0; i < SIM_NUM_WORKERS; i++) {
+    for(size_t i = 0; i < params->worker_count; i++) {
         pthread_join(workers[i]->thread_id, NULL);
         printf("[Main] Finished waiting for worker %d\n", workers[i]->id);
+        free(workers[i]);
     };
 
 
-    for(size_t i = 0; i < params.truck_count; i++) {
+    for(size_t i = 0; i < params->truck_count; i++) {
         pthread_join(trucks[i]->thread_id, NULL);
         printf("[Main] Finished waiting for truck %d\n", trucks[i]->id);
+        free(trucks[i]);
     };
 
+    return SIM_OK;
+}
+
+// Difference of CPU time (user + system) between two measurements, in seconds
+double _cpu_seconds(const struct rusage* start, const struct rusage* end) {
+    return (end->ru_utime.tv_sec - start->ru_utime.tv_sec) + (end->ru_utime.tv_usec - start->ru_utime.tv_usec) / 1e6
+        + (end->ru_stime.tv_sec - start->ru_stime.tv_sec) + (end->ru_stime.tv_usec - start->ru_stime.tv_usec) / 1e6;
+}
+
+int main(int argc, char** argv) {
+    sim_params_t params;
+    sim_params_init(&params);
+
+    sim_status_t status = sim_parse_args(&params, argc, argv);
+    if(status != SIM_OK) {
+        return status;
+    }
+
+    dispatch_t* dispatch = dispatch_init(params.dispatch_policy, params.truck_count);
+    if(!dispatch) {
+        puts("Error while creating dispatcher");
+        return SIM_ERROR_RUNTIME;
+    }
+
+    conveyor_t* conveyor = conveyor_init(params.max_bricks_count, params.max_bricks_mass, dispatch);
+
+    if(!conveyor) {
+        puts("Error while creating conveyor");
+        return SIM_ERROR_RUNTIME;
+    }
+    conveyor->brick_limit = params.stop_after_bricks;
+
+    ratectl_t* rate_control = NULL;
+    if(params.target_fill_percent > 0) {
+        // Bricks are taken away in bursts, one per truck return - average over the longest delivery
+        unsigned int longest_delivery = 0;
+        for(size_t i = 0; i < params.truck_count; i++) {
+            if(params.fleet[i].sleep_time > longest_delivery) {
+                longest_delivery = params.fleet[i].sleep_time;
+            }
+        }
+
+        size_t total_weight = 0;
+        for(size_t i = 0; i < params.worker_count; i++) {
+            total_weight += params.worker_weights[i];
+        }
+
+        rate_control = ratectl_init(conveyor, params.target_fill_percent / 100.0, longest_delivery, total_weight);
+        if(!rate_control) {
+            puts("Error while creating rate controller");
+            return SIM_ERROR_RUNTIME;
+        }
+    }
+
+    // SIGUSR2 is only ever received synchronously (sigtimedwait or signalfd),
+    // so it is blocked before starting any thread - they all inherit the mask
+    sigset_t usr2_set;
+    sigemptyset(&usr2_set);
+    sigaddset(&usr2_set, SIGUSR2);
+    if(pthread_sigmask(SIG_BLOCK, &usr2_set, NULL) != 0) {
+        puts("Error while  setting sigmask");
+        return SIM_ERROR_RUNTIME;
+    }
+
+    sampler_t* sampler = NULL;
+    if(params.samples_path[0] != '\0') {
+        sampler = sampler_init(conveyor, params.samples_path, params.sample_interval_ms);
+
+        if(sampler == NULL || sampler_start(sampler) == 0) {
+            puts("Error while starting the sampler");
+            return SIM_ERROR_RUNTIME;
+        }
+    }
+
+    // Wall-clock throughput is set by the truck delivery times, so the runtimes are compared
+    // by the CPU time and the context switches of the whole process (all threads) as well
+    struct timespec start, end;
+    struct rusage usage_start, usage_end;
+    getrusage(RUSAGE_SELF, &usage_start);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    if(params.use_event_loop) {
+        if(!engine_run(conveyor, &params)) {
+            puts("Error while running the event loop");
+            status = SIM_ERROR_RUNTIME;
+        }
+    } else {
+        status = _run_threads(conveyor, &params, rate_control);
+    }
+
+    if(status != SIM_OK) {
+        return status;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    getrusage(RUSAGE_SELF, &usage_end);
+
+    if(sampler != NULL) {
+        sampler_stop(sampler);
+    }
+
+    // Throughput summary, for comparing the runtimes and dispatch policies
+    dispatch_print_stats(dispatch);
+    uint64_t pacing_sleeps = 0;
+    if(rate_control) {
+        ratectl_print_stats(rate_control);
+        pacing_sleeps = rate_control->paced_bricks;
+        ratectl_destroy(rate_control);
+    }
+
+    conveyor_snapshot_t snap;
+    conveyor_snapshot(conveyor, &snap);
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("[Main] Delivered %llu bricks of total mass %llu in %.3fs (%.1f mass/s)\n",
+        (unsigned long long) snap.total_removed_count, (unsigned long long) snap.total_removed_mass,
+        elapsed, elapsed > 0 ? snap.total_removed_mass / elapsed : 0.0);
+    double cpu = _cpu_seconds(&usage_start, &usage_end);
+    printf("[Main] Used %.3fs of CPU time (%.1f mass per CPU-second), %ld voluntary and %ld involuntary context switches\n",
+        cpu, cpu > 0 ? snap.total_removed_mass / cpu : 0.0,
+        usage_end.ru_nvcsw - usage_start.ru_nvcsw, usage_end.ru_nivcsw - usage_start.ru_nivcsw);
+    // Paced workers are not blocked on a full conveyor, but they still sleep and wake up
+    printf("[Main] Workers waited for space on the conveyor %llu times and slept for pacing %llu times\n",
+        (unsigned long long) snap.total_space_waits, (unsigned long long) pacing_sleeps);
+
     conveyor_destroy(conveyor);
+    dispatch_destroy(dispatch);
+
+    return SIM_OK;
 }
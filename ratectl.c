@@ -0,0 +1,159 @@
+#include "ratectl.h"
+#include "worker.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+ratectl_t* ratectl_init(conveyor_t* c, double target_fill, double time_constant, size_t total_weight) {
+    if(c == NULL || target_fill <= 0 || target_fill > 1 || time_constant <= 0 || total_weight == 0) {
+        return NULL;
+    }
+
+    ratectl_t* r = malloc(sizeof(ratectl_t));
+    if(!r) {
+        return NULL;
+    }
+
+    r->conveyor = c;
+    r->target_fill = target_fill;
+    r->time_constant = time_constant;
+    r->total_weight = total_weight;
+    r->paced_bricks = 0;
+    r->total_delay_ms = 0;
+    r->steady_started = 0;
+    r->steady_stopped = 0;
+
+    // Delays are measured with the monotonic clock, like everything else
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&(r->stop_cond), &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&(r->mutex), NULL);
+
+    return r;
+}
+
+void ratectl_destroy(ratectl_t* r) {
+    pthread_cond_destroy(&(r->stop_cond));
+    pthread_mutex_destroy(&(r->mutex));
+    free(r);
+}
+
+void ratectl_state_init(ratectl_t* r, ratectl_state_t* state) {
+    conveyor_snapshot_t snap;
+    conveyor_snapshot(r->conveyor, &snap);
+
+    clock_gettime(CLOCK_MONOTONIC, &(state->last_time));
+    state->last_removed_mass = snap.total_removed_mass;
+    state->drain_rate = 0;
+}
+
+void ratectl_pace(ratectl_t* r, ratectl_state_t* state) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    conveyor_snapshot_t snap;
+    conveyor_snapshot(r->conveyor, &snap);
+
+    // Update the moving average of the mass taken away by trucks
+    // Weight of the new measurement grows with the time it covers
+    double dt = (now.tv_sec - state->last_time.tv_sec) + (now.tv_nsec - state->last_time.tv_nsec) / 1e9;
+    if(dt > 0) {
+        double measured = (snap.total_removed_mass - state->last_removed_mass) / dt;
+        state->drain_rate += (measured - state->drain_rate) * dt / (r->time_constant + dt);
+        state->last_time = now;
+        state->last_removed_mass = snap.total_removed_mass;
+    }
+
+    double fill = (double) snap.bricks_mass / r->conveyor->max_bricks_mass;
+
+    // Below the target there is no reason to wait - fill the conveyor up while the trucks are away
+    // First worker to see the target reached marks the start of the steady state
+    if(!__atomic_load_n(&(r->steady_started), __ATOMIC_ACQUIRE)) {
+        if(fill < r->target_fill) {
+            return;
+        }
+
+        pthread_mutex_lock(&(r->mutex));
+        if(!r->steady_started && !r->steady_stopped) {
+            r->steady_start_time = now;
+            r->steady_start_removed_mass = snap.total_removed_mass;
+            __atomic_store_n(&(r->steady_started), 1, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&(r->mutex));
+    }
+
+    // At the target, every worker produces at its share of the rate the bricks are taken away
+    // Without any estimate yet, wait for about one truck return
+    long max_delay_ms = (long) (r->time_constant * 1000);
+    double delay_ms = max_delay_ms;
+    double bricks_per_second = state->drain_rate / r->total_weight;
+    if(bricks_per_second * max_delay_ms > 1000) {
+        delay_ms = 1000 / bricks_per_second;
+    }
+
+    // The estimate alone keeps any fill level, the proportional term pulls the conveyor back to the target
+    delay_ms *= 1 + RATECTL_FILL_GAIN * (fill - r->target_fill) / r->target_fill;
+    if(delay_ms < 1) {
+        return;
+    }
+
+    __atomic_fetch_add(&(r->paced_bricks), 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&(r->total_delay_ms), (uint64_t) delay_ms, __ATOMIC_RELAXED);
+
+    // Single timed wait for the whole delay, cut short by ratectl_stop()
+    struct timespec deadline = now;
+    long delay_ns = (long) (delay_ms * 1000000);
+    deadline.tv_sec += delay_ns / 1000000000;
+    deadline.tv_nsec += delay_ns % 1000000000;
+    if(deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&(r->mutex));
+    while(!r->steady_stopped && !worker_stop_flag_is_set()) {
+        if(pthread_cond_timedwait(&(r->stop_cond), &(r->mutex), &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    pthread_mutex_unlock(&(r->mutex));
+}
+
+void ratectl_stop(ratectl_t* r) {
+    conveyor_snapshot_t snap;
+    conveyor_snapshot(r->conveyor, &snap);
+
+    pthread_mutex_lock(&(r->mutex));
+    clock_gettime(CLOCK_MONOTONIC, &(r->steady_stop_time));
+    r->steady_stop_removed_mass = snap.total_removed_mass;
+    r->steady_stopped = 1;
+    pthread_cond_broadcast(&(r->stop_cond));
+    pthread_mutex_unlock(&(r->mutex));
+}
+
+void ratectl_print_stats(ratectl_t* r) {
+    uint64_t paced = __atomic_load_n(&(r->paced_bricks), __ATOMIC_RELAXED);
+    uint64_t delay = __atomic_load_n(&(r->total_delay_ms), __ATOMIC_RELAXED);
+
+    printf("[RATECTL] target fill: %.0f%%, paced bricks: %llu, average delay: %llums, ",
+        r->target_fill * 100,
+        (unsigned long long) paced,
+        (unsigned long long) (paced > 0 ? delay / paced : 0));
+
+    double elapsed = 0;
+    if(__atomic_load_n(&(r->steady_started), __ATOMIC_ACQUIRE) && r->steady_stopped) {
+        elapsed = (r->steady_stop_time.tv_sec - r->steady_start_time.tv_sec)
+            + (r->steady_stop_time.tv_nsec - r->steady_start_time.tv_nsec) / 1e9;
+    }
+
+    if(elapsed <= 0) {
+        printf("steady-state throughput: target fill not reached\n");
+        return;
+    }
+
+    printf("steady-state throughput: %.1f mass/s over %.1fs\n",
+        (r->steady_stop_removed_mass - r->steady_start_removed_mass) / elapsed, elapsed);
+}
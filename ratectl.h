@@ -0,0 +1,84 @@
+#ifndef _RATECTL_H_
+#define _RATECTL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "conveyor.h"
+
+// Strength of the correction of the fill error: the delay is multiplied by
+// 1 + RATECTL_FILL_GAIN * (fill - target_fill) / target_fill
+// so it doubles when the conveyor is above the target by half of the target, and drops to zero below it
+#define RATECTL_FILL_GAIN 2.0
+
+// Optional pacing of the workers - instead of producing as fast as possible and then blocking
+// on a full conveyor, workers produce at the rate trucks take the bricks away,
+// keeping the conveyor mass near a target fill level
+struct ratectl_t {
+    // Reference to the observed conveyor structure, read with conveyor_snapshot()
+    conveyor_t* conveyor;
+
+    // Target mass on the conveyor, as a fraction of max_bricks_mass
+    double target_fill;
+
+    // Time over which the rate of trucks taking the bricks away is averaged (in seconds)
+    // Should be about the time it takes trucks to return, so that deliveries are smoothed out
+    double time_constant;
+
+    // Sum of weights of bricks of all workers - every worker produces the same number of bricks,
+    // so one brick of each worker adds that much mass
+    size_t total_weight;
+
+    // Statistics, updated atomically by the workers
+    uint64_t paced_bricks; // Bricks that had to wait for their slot - each is one sleep and one wake-up
+    uint64_t total_delay_ms;
+
+    // Protects the steady state fields, paced workers wait on the condition variable
+    // so that ratectl_stop() can wake them up before their delay ends
+    pthread_mutex_t mutex;
+    pthread_cond_t stop_cond;
+
+    // Steady state lasts from the moment the conveyor first reached the target fill until ratectl_stop()
+    // Workers produce freely until it starts, then they are paced
+    int steady_started;
+    struct timespec steady_start_time;
+    uint64_t steady_start_removed_mass;
+
+    // Set by ratectl_stop(), no steady state starts after it
+    int steady_stopped;
+    struct timespec steady_stop_time;
+    uint64_t steady_stop_removed_mass;
+};
+typedef struct ratectl_t ratectl_t;
+
+// Per-worker state of the controller, kept by the worker thread
+struct ratectl_state_t {
+    struct timespec last_time;
+    uint64_t last_removed_mass;
+    double drain_rate; // Estimated mass taken away per second
+};
+typedef struct ratectl_state_t ratectl_state_t;
+
+// Creates a new controller, returns NULL in case of error
+// Arguments: conveyor, target fill (0, 1], time constant in seconds, total weight of bricks of all workers
+ratectl_t* ratectl_init(conveyor_t*, double, double, size_t);
+
+void ratectl_destroy(ratectl_t*);
+
+// Initializes the state of a single worker
+void ratectl_state_init(ratectl_t*, ratectl_state_t*);
+
+// Called by a worker before producing a brick, sleeps for as long as needed to keep the target fill
+void ratectl_pace(ratectl_t*, ratectl_state_t*);
+
+// Marks the end of the steady state and wakes up paced workers, to be called once the production stops
+void ratectl_stop(ratectl_t*);
+
+// Prints the statistics gathered so far
+// Steady-state throughput is the mass taken away by trucks between reaching the target fill
+// and ratectl_stop(), divided by the time between them
+void ratectl_print_stats(ratectl_t*);
+
+#endif
@@ -0,0 +1,246 @@
+#include "sampler.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// sampler thread main function (defined at the bottom)
+void* _sampler_main(void*);
+
+// Writes n values of a column from the ring, oldest first, returns 0 on success
+int _sampler_write_column(sampler_t* s, const void* column, size_t item_size) {
+    const char* base = (const char*) column;
+    size_t first_part = s->ring_count;
+
+    if(s->ring_start + first_part > SAMPLER_RING_SIZE) {
+        first_part = SAMPLER_RING_SIZE - s->ring_start;
+    }
+
+    if(fwrite(base + s->ring_start * item_size, item_size, first_part, s->out) != first_part) {
+        return 1;
+    }
+
+    // Rest of the samples wrapped around to the beginning of the ring
+    size_t second_part = s->ring_count - first_part;
+    if(fwrite(base, item_size, second_part, s->out) != second_part) {
+        return 1;
+    }
+
+    return 0;
+}
+
+// Writes all samples from the ring as a single block and empties the ring, returns 0 on success
+// In case of error the ring is left untouched and the file is cut back to the end of the previous block,
+// if that is not possible no more blocks are written, so the file never holds a partial block followed by more data
+int _sampler_flush(sampler_t* s) {
+    if(s->ring_count == 0 || s->write_failed) {
+        return s->write_failed;
+    }
+
+    long block_offset = ftell(s->out);
+    if(block_offset < 0) {
+        int errno_tmp = errno;
+        fprintf(stderr, "Error while writing samples: %s\n", strerror(errno_tmp));
+        s->write_failed = 1;
+        return 1;
+    }
+
+    uint32_t n = (uint32_t) s->ring_count;
+    int failed = fwrite(&n, sizeof(n), 1, s->out) != 1;
+
+    failed = failed || _sampler_write_column(s, s->time_ms, sizeof(uint32_t));
+    failed = failed || _sampler_write_column(s, s->bricks_count, sizeof(uint16_t));
+    failed = failed || _sampler_write_column(s, s->bricks_mass, sizeof(uint16_t));
+    failed = failed || _sampler_write_column(s, s->truck_reservation, sizeof(uint16_t));
+
+    // Throughput counters are stored as deltas from the previous sample, which fit in 32 bits
+    for(int k = 0; k < SAMPLER_NUM_TOTALS && !failed; k++) {
+        uint32_t deltas[SAMPLER_RING_SIZE];
+        uint64_t previous = s->flushed_totals[k];
+
+        for(size_t i = 0; i < s->ring_count; i++) {
+            uint64_t current = s->totals[k][(s->ring_start + i) % SAMPLER_RING_SIZE];
+            deltas[i] = (uint32_t) (current - previous);
+            previous = current;
+        }
+
+        failed = fwrite(&(s->flushed_totals[k]), sizeof(uint64_t), 1, s->out) != 1
+            || fwrite(deltas, sizeof(uint32_t), s->ring_count, s->out) != s->ring_count;
+    }
+
+    failed = failed || fflush(s->out) != 0;
+    if(failed) {
+        int errno_tmp = errno;
+        fprintf(stderr, "Error while writing samples: %s\n", strerror(errno_tmp));
+
+        // Drop the part of the block that was written, the whole ring is written again next time
+        if(fseek(s->out, block_offset, SEEK_SET) != 0 || ftruncate(fileno(s->out), block_offset) != 0) {
+            fprintf(stderr, "Error while removing a partially written block of samples, no more samples will be written\n");
+            s->write_failed = 1;
+        }
+        return 1;
+    }
+
+    // Remember where the block ended, so the next one can continue the deltas
+    size_t newest = (s->ring_start + s->ring_count - 1) % SAMPLER_RING_SIZE;
+    for(int k = 0; k < SAMPLER_NUM_TOTALS; k++) {
+        s->flushed_totals[k] = s->totals[k][newest];
+    }
+
+    s->ring_start = 0;
+    s->ring_count = 0;
+    return 0;
+}
+
+// Stores a single sample in the ring, flushing it first if it is full
+// If flushing fails the oldest sample is overwritten, so the ring always has the latest data
+// Every SAMPLER_FLUSH_INTERVAL_MS the ring is flushed even if it is not full
+void _sampler_record(sampler_t* s, uint32_t time_ms, const conveyor_snapshot_t* snap) {
+    if(s->ring_count == SAMPLER_RING_SIZE && _sampler_flush(s) != 0) {
+        for(int k = 0; k < SAMPLER_NUM_TOTALS; k++) {
+            s->flushed_totals[k] = s->totals[k][s->ring_start];
+        }
+        s->ring_start = (s->ring_start + 1) % SAMPLER_RING_SIZE;
+        s->ring_count--;
+    }
+
+    size_t i = (s->ring_start + s->ring_count) % SAMPLER_RING_SIZE;
+    s->time_ms[i] = time_ms;
+    s->bricks_count[i] = (uint16_t) snap->bricks_count;
+    s->bricks_mass[i] = (uint16_t) snap->bricks_mass;
+    s->truck_reservation[i] = (uint16_t) snap->truck_reservation;
+    s->totals[0][i] = snap->total_inserted_count;
+    s->totals[1][i] = snap->total_inserted_mass;
+    s->totals[2][i] = snap->total_removed_count;
+    s->totals[3][i] = snap->total_removed_mass;
+    s->ring_count++;
+
+    // Failed flush is not retried before the next interval, the full ring still limits the loss
+    if(time_ms - s->flushed_time_ms >= SAMPLER_FLUSH_INTERVAL_MS) {
+        s->flushed_time_ms = time_ms;
+        _sampler_flush(s);
+    }
+}
+
+sampler_t* sampler_init(conveyor_t* c, const char* path, unsigned int interval_ms) {
+    // Counters are stored in 16 bits to keep the file compact
+    if(c == NULL || interval_ms == 0 || c->max_bricks_count > UINT16_MAX || c->max_bricks_mass > UINT16_MAX) {
+        fprintf(stderr, "Error - invalid sampler parameters\n");
+        return NULL;
+    }
+
+    sampler_t* s = malloc(sizeof(sampler_t));
+    if(!s) {
+        return NULL;
+    }
+
+    s->out = fopen(path, "wb");
+    if(!s->out) {
+        int errno_tmp = errno;
+        fprintf(stderr, "Error opening samples file \"%s\": %s\n", path, strerror(errno_tmp));
+        free(s);
+        return NULL;
+    }
+
+    s->conveyor = c;
+    s->interval_ms = interval_ms;
+    s->ring_start = 0;
+    s->ring_count = 0;
+    s->write_failed = 0;
+    s->stop_flag = 0;
+    s->flushed_time_ms = 0;
+    memset(s->flushed_totals, 0, sizeof(s->flushed_totals));
+
+    uint16_t version[2] = { SAMPLER_VERSION, 0 };
+    uint32_t header[3] = { interval_ms, (uint32_t) c->max_bricks_count, (uint32_t) c->max_bricks_mass };
+    if(fwrite(SAMPLER_MAGIC, 1, 4, s->out) != 4
+        || fwrite(version, sizeof(version), 1, s->out) != 1
+        || fwrite(header, sizeof(header), 1, s->out) != 1) {
+        int errno_tmp = errno;
+        fprintf(stderr, "Error writing samples file header: %s\n", strerror(errno_tmp));
+        fclose(s->out);
+        free(s);
+        return NULL;
+    }
+
+    // Sample times are measured with the monotonic clock, so is the wait between them
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&(s->stop_cond), &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&(s->stop_mutex), NULL);
+
+    return s;
+}
+
+int sampler_start(sampler_t* s) {
+    // Try to start thread, and check result
+    // We pass address of the _sampler_main function as the thread routine
+    int result = pthread_create(&(s->thread_id), NULL, &_sampler_main, (void*) s);
+    if(result != 0) {
+        return 0;
+    };
+
+    return 1;
+}
+
+void sampler_stop(sampler_t* s) {
+    pthread_mutex_lock(&(s->stop_mutex));
+    s->stop_flag = 1;
+    pthread_cond_signal(&(s->stop_cond));
+    pthread_mutex_unlock(&(s->stop_mutex));
+    pthread_join(s->thread_id, NULL);
+
+    _sampler_flush(s);
+    fclose(s->out);
+    pthread_cond_destroy(&(s->stop_cond));
+    pthread_mutex_destroy(&(s->stop_mutex));
+    free(s);
+}
+
+// Difference between two points in time, in milliseconds
+uint32_t _sampler_elapsed_ms(const struct timespec* start, const struct timespec* now) {
+    return (uint32_t) ((now->tv_sec - start->tv_sec) * 1000 + (now->tv_nsec - start->tv_nsec) / 1000000);
+}
+
+void* _sampler_main(void* arg) {
+    sampler_t* s = (sampler_t*) arg;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Wake-ups are scheduled at absolute times, so the interval does not drift
+    // by the time spent taking and storing the sample
+    struct timespec next = start;
+
+    pthread_mutex_lock(&(s->stop_mutex));
+    while(!s->stop_flag) {
+        pthread_mutex_unlock(&(s->stop_mutex));
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+
+        conveyor_snapshot_t snap;
+        conveyor_snapshot(s->conveyor, &snap);
+        _sampler_record(s, _sampler_elapsed_ms(&start, &now), &snap);
+
+        next.tv_sec += s->interval_ms / 1000;
+        next.tv_nsec += (long) (s->interval_ms % 1000) * 1000000;
+        if(next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+
+        // sampler_stop() wakes the thread up before the next sample is due
+        pthread_mutex_lock(&(s->stop_mutex));
+        while(!s->stop_flag && pthread_cond_timedwait(&(s->stop_cond), &(s->stop_mutex), &next) != ETIMEDOUT);
+    }
+    pthread_mutex_unlock(&(s->stop_mutex));
+
+    pthread_exit(NULL);
+}
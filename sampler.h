@@ -0,0 +1,86 @@
+#ifndef _SAMPLER_H_
+#define _SAMPLER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "conveyor.h"
+
+// Samples file layout (all values in host byte order):
+//   header: "CGSM", uint16 version, uint16 reserved, uint32 interval_ms, uint32 K, uint32 M
+//   then any number of blocks, each holding n samples stored column after column:
+//     uint32 n
+//     uint32 time[n]               - milliseconds since the sampler started
+//     uint16 bricks_count[n]
+//     uint16 bricks_mass[n]
+//     uint16 truck_reservation[n]  - ID of the truck at the dock, 0 if none
+//     4 x (uint64 base, uint32 delta[n]) - inserted count, inserted mass, removed count, removed mass
+//       value of sample i is base + delta[0] + ... + delta[i], base is the value before the block
+// scripts/samples_to_csv.py decodes it
+#define SAMPLER_MAGIC "CGSM"
+#define SAMPLER_VERSION 1
+
+// Number of samples kept in memory before they are flushed to the file
+#define SAMPLER_RING_SIZE 1024
+
+// Samples are also flushed this often, so an interrupted run loses at most that much data
+#define SAMPLER_FLUSH_INTERVAL_MS 2000
+
+// Number of throughput counters stored in every sample
+#define SAMPLER_NUM_TOTALS 4
+
+struct sampler_t {
+    // Reference to the observed conveyor structure
+    conveyor_t* conveyor;
+
+    // Time between two samples (in milliseconds)
+    unsigned int interval_ms;
+
+    // File the samples are flushed to
+    FILE* out;
+
+    // Ring of samples, one array per column
+    // ring_start is the index of the oldest sample, ring_count the number of stored samples
+    size_t ring_start;
+    size_t ring_count;
+    uint32_t time_ms[SAMPLER_RING_SIZE];
+    uint16_t bricks_count[SAMPLER_RING_SIZE];
+    uint16_t bricks_mass[SAMPLER_RING_SIZE];
+    uint16_t truck_reservation[SAMPLER_RING_SIZE];
+    uint64_t totals[SAMPLER_NUM_TOTALS][SAMPLER_RING_SIZE];
+
+    // Values of the throughput counters at the end of the previously flushed block
+    uint64_t flushed_totals[SAMPLER_NUM_TOTALS];
+
+    // Time of the previous flush (or of the start), in milliseconds since the sampler started
+    uint32_t flushed_time_ms;
+
+    // Set to 1 after the first failed write, no more blocks are written to the file then
+    int write_failed;
+
+    // Set by sampler_stop(), which also signals the condition variable
+    // so the sampler thread does not sleep until the next sample
+    int stop_flag;
+    pthread_mutex_t stop_mutex;
+    pthread_cond_t stop_cond;
+
+    // Sampler thread
+    pthread_t thread_id;
+};
+typedef struct sampler_t sampler_t;
+
+// Create a sampler writing to the file at given path every interval_ms milliseconds
+// Writes the file header, returns NULL in case of error
+// Does NOT start the thread
+sampler_t* sampler_init(conveyor_t*, const char*, unsigned int);
+
+// Start the thread of an initialized sampler
+// Returns 0 in case of error
+int sampler_start(sampler_t*);
+
+// Stop the sampler thread, flush the remaining samples, close the file and free the structure
+void sampler_stop(sampler_t*);
+
+#endif
@@ -1,3 +1,3 @@
 #!/bin/bash
 
-gcc -Wall -Wextra -Werror -pedantic -Wno-error=unused-parameter -pthread conveyor.c main.c worker.c truck.c sim.c -o cegielnia
+gcc -Wall -Wextra -Werror -pedantic -Wno-error=unused-parameter -pthread conveyor.c main.c worker.c truck.c sim.c sampler.c engine.c dispatch.c ratectl.c -o cegielnia
@@ -0,0 +1,9 @@
+#!/bin/bash
+# Builds the stress test, "tsan" as the first argument builds it with ThreadSanitizer
+
+FLAGS="-O2"
+if [ "$1" == "tsan" ]; then
+    FLAGS="-O1 -g -fsanitize=thread"
+fi
+
+gcc -Wall -Wextra -Werror -pedantic -Wno-error=unused-parameter -pthread $FLAGS -DCONVEYOR_NO_LOG -DCONVEYOR_TRACE_BRICKS -I. conveyor.c worker.c dispatch.c ratectl.c tests/stress.c -o stress
@@ -0,0 +1,84 @@
+import struct
+import sys
+
+# Decodes the samples file written by the sampler module (layout described in sampler.h),
+# averages every N consecutive samples into one row and prints the result as CSV
+
+if(len(sys.argv) not in (2, 3)):
+    print("Usage:", sys.argv[0], "[filename] [samples per row, default 1]")
+    exit(0)
+
+every = int(sys.argv[2]) if len(sys.argv) == 3 else 1
+if every < 1:
+    print("Samples per row must be at least 1")
+    exit(1)
+
+with open(sys.argv[1], 'rb') as f:
+    data = f.read()
+
+if data[0:4] != b'CGSM':
+    print("Not a samples file")
+    exit(1)
+
+version, _, interval_ms, max_count, max_mass = struct.unpack_from('=HHIII', data, 4)
+if version != 1:
+    print("Unsupported samples file version", version)
+    exit(1)
+
+offset = 20
+samples = []
+while offset < len(data):
+    # A run killed while writing a block leaves it incomplete, all blocks before it are valid
+    n, = struct.unpack_from('=I', data, offset) if offset + 4 <= len(data) else (0,)
+    if offset + 36 + 26 * n > len(data):
+        print("Incomplete block at the end of the file, ignored", file=sys.stderr)
+        break
+    offset += 4
+
+    def column(fmt, size):
+        global offset
+        values = struct.unpack_from('=' + fmt * n, data, offset)
+        offset += size * n
+        return values
+
+    times = column('I', 4)
+    counts = column('H', 2)
+    masses = column('H', 2)
+    docks = column('H', 2)
+
+    totals = []
+    for _ in range(4):
+        base, = struct.unpack_from('=Q', data, offset)
+        offset += 8
+        running = []
+        for delta in column('I', 4):
+            base += delta
+            running.append(base)
+        totals.append(running)
+
+    for i in range(n):
+        samples.append((times[i], counts[i], masses[i], docks[i]) + tuple(t[i] for t in totals))
+
+print(f"# interval_ms={interval_ms} K={max_count} M={max_mass}")
+print("time_ms,avg_count,max_count,avg_mass,max_mass,dock,inserted_count,inserted_mass,removed_count,removed_mass,removed_mass_per_s")
+
+previous = None
+for start in range(0, len(samples), every):
+    group = samples[start:start + every]
+    last = group[-1]
+
+    rate = ''
+    if previous is not None and last[0] > previous[0]:
+        rate = f"{(last[7] - previous[7]) * 1000 / (last[0] - previous[0]):.2f}"
+
+    print(','.join(str(v) for v in (
+        last[0],
+        f"{sum(s[1] for s in group) / len(group):.2f}",
+        max(s[1] for s in group),
+        f"{sum(s[2] for s in group) / len(group):.2f}",
+        max(s[2] for s in group),
+        last[3],
+        last[4], last[5], last[6], last[7],
+        rate,
+    )))
+    previous = last
@@ -5,14 +5,57 @@
 #include <string.h>
 #include <errno.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <limits.h> // ULONG_MAX definition
+#include <ctype.h>
 
 #define BUFFER_SIZE 64
 
+// Lines of config and fleet files
+#define LINE_SIZE 512
+
+// Ranges from the task description
+#define SIM_MIN_BRICKS_COUNT 3
+#define SIM_MAX_BRICKS_COUNT 5000
+#define SIM_MIN_BRICKS_MASS 6
+#define SIM_MIN_TRUCK_CAPACITY 3
+#define SIM_MAX_TRUCK_CAPACITY 500
+#define SIM_MAX_TRUCK_SLEEP_TIME 20
+
+// Bricks store their mass in a single byte
+#define SIM_MAX_BRICK_WEIGHT 255
+
+#define SIM_MAX_SAMPLE_INTERVAL_MS 60000
+
+// Command line options setting a single parameter, named like the keys of the config file
+struct _sim_option_t {
+    char option;
+    const char* key;
+};
+
+static const struct _sim_option_t _sim_options[] = {
+    { 'K', "max_bricks_count" },
+    { 'M', "max_bricks_mass" },
+    { 'C', "truck_capacity" },
+    { 'N', "truck_count" },
+    { 'T', "truck_sleep_time" },
+    { 'f', "fleet" },
+    { 'w', "workers" },
+    { 'd', "dispatch" },
+    { 'r', "runtime" },
+    { 'o', "samples_file" },
+    { 'i', "sample_interval_ms" },
+    { 'p', "target_fill_percent" },
+    { 'b', "stop_after_bricks" },
+    { 't', "stop_after_seconds" },
+};
+
+#define SIM_NUM_OPTIONS (sizeof(_sim_options) / sizeof(_sim_options[0]))
+
 void _remove_newline(char* buffer, size_t max_length) {
     size_t len = strnlen(buffer, max_length);
 
-    if(buffer[len - 1] == '\n') {
+    if(len > 0 && buffer[len - 1] == '\n') {
         buffer[len - 1] = '\0';
     }
 }
@@ -35,80 +78,561 @@ int _try_parse_number(char* buffer, unsigned long* result) {
     }
 }
 
-unsigned long _get_number_from_user(char* buffer, size_t max_length) {
-    unsigned long result = 0;
+// Stricter variant of _try_parse_number() for config values - the whole text has to be a number
+int _try_parse_whole_number(const char* text, unsigned long* result) {
+    char* endptr = (char*) text;
+    errno = 0;
+    unsigned long result_tmp = strtoul(text, &endptr, 10);
+
+    // strtoul() skips leading whitespace and accepts negative numbers, wrapping them around
+    const char* first = text;
+    while(isspace((unsigned char) *first)) {
+        first++;
+    }
+
+    if(errno != 0 || endptr == text || *endptr != '\0' || *first == '-') {
+        return 1;
+    }
+
+    *result = result_tmp;
+    return 0;
+}
+
+// Removes whitespace from both ends of the string, returns the new beginning
+char* _trim(char* text) {
+    while(*text == ' ' || *text == '\t') {
+        text++;
+    }
+
+    size_t len = strlen(text);
+    while(len > 0 && (text[len - 1] == ' ' || text[len - 1] == '\t' || text[len - 1] == '\r' || text[len - 1] == '\n')) {
+        text[--len] = '\0';
+    }
+
+    return text;
+}
 
-    fgets(buffer, max_length, stdin);
+sim_status_t _get_number_from_user(char* buffer, size_t max_length, unsigned long* result) {
+    if(fgets(buffer, max_length, stdin) == NULL) {
+        fprintf(stderr, "Error - unexpected end of input\n");
+        return SIM_ERROR_SYNTAX;
+    }
     _remove_newline(buffer, max_length);
 
-    if(_try_parse_number(buffer, &result) != 0) {
+    if(_try_parse_number(buffer, result) != 0) {
         fprintf(stderr, "Error - cannot parse input \"%s\" as number\n", buffer);
-        exit(0);
+        return SIM_ERROR_SYNTAX;
     };
 
-    return result;
+    return SIM_OK;
 }
 
-void sim_query_user_for_params(sim_params_t* p) {
+void _print_summary(sim_params_t* p) {
+    fprintf(stderr, "%s\n", "simulation summary:");
+    fprintf(stderr, "conveyor brick count (K) - %lu\n", p->max_bricks_count);
+    fprintf(stderr, "conveyor brick mass (M) - %lu\n", p->max_bricks_mass);
+    fprintf(stderr, "truck count (N) - %lu\n", p->truck_count);
+    for(size_t i = 0; i < p->truck_count; i++) {
+        fprintf(stderr, "truck %zu capacity (C) - %zu, sleep time (Ti) - %u\n", i + 1, p->fleet[i].capacity, p->fleet[i].sleep_time);
+    }
+    for(size_t i = 0; i < p->worker_count; i++) {
+        fprintf(stderr, "worker %zu brick weight - %zu\n", i + 1, p->worker_weights[i]);
+    }
+    if(p->stop_after_bricks > 0) {
+        fprintf(stderr, "stop after bricks - %llu\n", (unsigned long long) p->stop_after_bricks);
+    }
+    if(p->stop_after_seconds > 0) {
+        fprintf(stderr, "stop after seconds - %u\n", p->stop_after_seconds);
+    }
+}
+
+void sim_params_init(sim_params_t* p) {
+    memset(p, 0, sizeof(sim_params_t));
+
+    // Hardcoded in task description
+    p->worker_count = 3;
+    for(size_t i = 0; i < p->worker_count; i++) {
+        p->worker_weights[i] = i + 1;
+    }
+
+    p->dispatch_policy = DISPATCH_FIFO;
+    p->sample_interval_ms = 100;
+}
+
+sim_status_t sim_query_user_for_params(sim_params_t* p) {
     char buffer[BUFFER_SIZE] = { 0 };
 
     unsigned long current_value = 0;
+    sim_status_t status;
 
     fprintf(stderr, "%s\n", "Initialize simulation parameters:");
     fprintf(stderr, "%s\n", "Input the maximum number of bricks in the conveyor (K)");
     fprintf(stderr, "%s\n", "in the range of <3, 5000>:");
-    current_value = _get_number_from_user(buffer, BUFFER_SIZE);
-    
-    if(current_value < 3 || current_value > 5000){
+    if((status = _get_number_from_user(buffer, BUFFER_SIZE, &current_value)) != SIM_OK) {
+        return status;
+    }
+
+    if(current_value < SIM_MIN_BRICKS_COUNT || current_value > SIM_MAX_BRICKS_COUNT){
         fprintf(stderr, "Error - input value is outside the range or invalid number. The program is terminated\n");
-        exit(0);
+        return SIM_ERROR_RANGE;
     }
     p->max_bricks_count = (size_t) current_value;
 
     fprintf(stderr, "%s\n", "Input the maximum total mass of bricks in the conveyor (M)");
     fprintf(stderr, "in the range of <6, %lu>:\n", (3 * p->max_bricks_count) - 1); // 3K > M")
-    current_value = _get_number_from_user(buffer, BUFFER_SIZE);
-    
-    if(current_value < 6 || current_value > ((3 * p->max_bricks_count) - 1)){
+    if((status = _get_number_from_user(buffer, BUFFER_SIZE, &current_value)) != SIM_OK) {
+        return status;
+    }
+
+    if(current_value < SIM_MIN_BRICKS_MASS || current_value > ((3 * p->max_bricks_count) - 1)){
         fprintf(stderr, "Error - input value is outside the range or invalid number. The program is terminated\n");
-        exit(0);
+        return SIM_ERROR_RANGE;
     }
     p->max_bricks_mass = (size_t) current_value;
 
+    // Trucks already described by the fleet file
+    if(p->fleet_size > 0) {
+        return SIM_OK;
+    }
+
     fprintf(stderr, "%s\n", "Input maximum total mass of bricks in a single truck (capacity, C)");
     fprintf(stderr, "%s\n", "in the range of <3, 500>:");
-    current_value = _get_number_from_user(buffer, BUFFER_SIZE);
-    
-    if(current_value < 3 || current_value > 500){
+    if((status = _get_number_from_user(buffer, BUFFER_SIZE, &current_value)) != SIM_OK) {
+        return status;
+    }
+
+    if(current_value < SIM_MIN_TRUCK_CAPACITY || current_value > SIM_MAX_TRUCK_CAPACITY){
         fprintf(stderr, "Error - input value is outside the range or invalid number. The program is terminated\n");
-        exit(0);
+        return SIM_ERROR_RANGE;
     }
     p->truck_capacity = (size_t) current_value;
 
     fprintf(stderr, "%s\n", "Input number of trucks (N)");
     fprintf(stderr, "%s\n", "in the range of <1, 20>:");
-    current_value = _get_number_from_user(buffer, BUFFER_SIZE);
-    
+    if((status = _get_number_from_user(buffer, BUFFER_SIZE, &current_value)) != SIM_OK) {
+        return status;
+    }
+
     if(current_value == 0 || current_value > 20){
         fprintf(stderr, "Error - input value is outside the range or invalid number. The program is terminated\n");
-        exit(0);
+        return SIM_ERROR_RANGE;
     }
     p->truck_count = (size_t) current_value;
 
     fprintf(stderr, "%s\n", "Input truck sleep time (Ti) in seconds");
     fprintf(stderr, "%s\n", "in the range of <1, 20>:");
-    current_value = _get_number_from_user(buffer, BUFFER_SIZE);
+    if((status = _get_number_from_user(buffer, BUFFER_SIZE, &current_value)) != SIM_OK) {
+        return status;
+    }
 
-    if(current_value == 0 || current_value > 20){
+    if(current_value == 0 || current_value > SIM_MAX_TRUCK_SLEEP_TIME){
         fprintf(stderr, "Error - input value is outside the range or invalid number. The program is terminated\n");
-        exit(0);
+        return SIM_ERROR_RANGE;
     }
     p->truck_sleep_time = current_value;
 
-    fprintf(stderr, "%s\n", "simulation summary:");
-    fprintf(stderr, "conveyor brick count (K) - %lu\n", p->max_bricks_count);
-    fprintf(stderr, "conveyor brick mass (M) - %lu\n", p->max_bricks_mass);
-    fprintf(stderr, "truck capacity (C) - %lu\n", p->truck_capacity);
-    fprintf(stderr, "truck count (N) - %lu\n", p->truck_count);
-    fprintf(stderr, "truck sleep time (Ti) - %u\n", p->truck_sleep_time);
+    return SIM_OK;
+}
+
+// Parses a single fleet line "capacity sleep_time [count]" and appends the trucks to the fleet
+// origin describes where the line comes from, for error messages
+sim_status_t _parse_fleet_line(sim_params_t* p, char* line, const char* origin) {
+    unsigned long values[3] = { 0, 0, 1 }; // count is optional
+    size_t value_count = 0;
+
+    char* cursor = NULL;
+    for(char* token = strtok_r(line, " \t\r\n", &cursor); token != NULL; token = strtok_r(NULL, " \t\r\n", &cursor)) {
+        if(value_count == 3 || _try_parse_whole_number(token, &(values[value_count])) != 0) {
+            fprintf(stderr, "Error - %s: truck should be described as \"capacity sleep_time [count]\"\n", origin);
+            return SIM_ERROR_SYNTAX;
+        }
+        value_count++;
+    }
+
+    if(value_count < 2) {
+        fprintf(stderr, "Error - %s: truck should be described as \"capacity sleep_time [count]\"\n", origin);
+        return SIM_ERROR_SYNTAX;
+    }
+
+    unsigned long capacity = values[0], sleep_time = values[1], count = values[2];
+    if(capacity < SIM_MIN_TRUCK_CAPACITY || capacity > SIM_MAX_TRUCK_CAPACITY || sleep_time == 0 || sleep_time > SIM_MAX_TRUCK_SLEEP_TIME) {
+        fprintf(stderr, "Error - %s: capacity has to be in the range of <3, 500> and sleep time in <1, 20>\n", origin);
+        return SIM_ERROR_RANGE;
+    }
+    if(count == 0 || count > SIM_MAX_TRUCKS - p->fleet_size) {
+        fprintf(stderr, "Error - %s: total number of trucks has to be in the range of <1, %d>\n", origin, SIM_MAX_TRUCKS);
+        return SIM_ERROR_RANGE;
+    }
+
+    for(unsigned long i = 0; i < count; i++) {
+        p->fleet[p->fleet_size].capacity = capacity;
+        p->fleet[p->fleet_size].sleep_time = (unsigned int) sleep_time;
+        p->fleet_size++;
+    }
+
+    return SIM_OK;
+}
+
+// Reads the next meaningful line of a config or fleet file into buffer, stripping the comment
+// Returns 1 if a line was read, 0 at the end of the file, -1 if the line is too long
+int _read_line(FILE* f, char* buffer, size_t* line_number) {
+    while(fgets(buffer, LINE_SIZE, f) != NULL) {
+        (*line_number)++;
+
+        size_t len = strlen(buffer);
+        if(len == LINE_SIZE - 1 && buffer[len - 1] != '\n' && !feof(f)) {
+            return -1;
+        }
+
+        char* comment = strchr(buffer, '#');
+        if(comment) {
+            *comment = '\0';
+        }
+
+        if(*_trim(buffer) != '\0') {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+sim_status_t sim_load_fleet(sim_params_t* p, const char* path) {
+    FILE* f = fopen(path, "r");
+    if(!f) {
+        int errno_tmp = errno;
+        fprintf(stderr, "Error opening fleet file \"%s\": %s\n", path, strerror(errno_tmp));
+        return SIM_ERROR_FILE;
+    }
+
+    // Fleet file replaces any trucks described before
+    p->fleet_size = 0;
+
+    char buffer[LINE_SIZE];
+    char origin[SIM_PATH_SIZE + 32];
+    size_t line_number = 0;
+    sim_status_t status = SIM_OK;
+    int result;
+
+    while(status == SIM_OK && (result = _read_line(f, buffer, &line_number)) != 0) {
+        snprintf(origin, sizeof(origin), "fleet file %s:%zu", path, line_number);
+
+        if(result < 0) {
+            fprintf(stderr, "Error - %s: line too long\n", origin);
+            status = SIM_ERROR_SYNTAX;
+        } else {
+            status = _parse_fleet_line(p, _trim(buffer), origin);
+        }
+    }
+
+    fclose(f);
+
+    if(status == SIM_OK && p->fleet_size == 0) {
+        fprintf(stderr, "Error - fleet file \"%s\" does not describe any truck\n", path);
+        status = SIM_ERROR_RANGE;
+    }
+
+    return status;
+}
+
+// Parses a number for the given key, printing an error if it is not one
+sim_status_t _parse_value(const char* value, unsigned long max, unsigned long* result, const char* key, const char* origin) {
+    if(_try_parse_whole_number(value, result) != 0) {
+        fprintf(stderr, "Error - %s: cannot parse \"%s\" as number for %s\n", origin, value, key);
+        return SIM_ERROR_SYNTAX;
+    }
+
+    if(*result > max) {
+        fprintf(stderr, "Error - %s: value of %s is too large\n", origin, key);
+        return SIM_ERROR_RANGE;
+    }
+
+    return SIM_OK;
+}
+
+// Parses the comma separated list of brick weights of the workers
+sim_status_t _parse_workers(sim_params_t* p, char* value, const char* origin) {
+    size_t count = 0;
+    size_t weights[SIM_MAX_WORKERS];
+
+    // strsep() returns empty tokens for consecutive commas, so "1,,2" is rejected instead of read as two workers
+    char* cursor = value;
+    for(char* token = strsep(&cursor, ","); token != NULL; token = strsep(&cursor, ",")) {
+        if(count == SIM_MAX_WORKERS) {
+            fprintf(stderr, "Error - %s: at most %d workers are supported\n", origin, SIM_MAX_WORKERS);
+            return SIM_ERROR_RANGE;
+        }
+
+        unsigned long weight;
+        sim_status_t status = _parse_value(_trim(token), ULONG_MAX, &weight, "workers", origin);
+        if(status != SIM_OK) {
+            return status;
+        }
+        weights[count++] = weight;
+    }
+
+    if(count == 0) {
+        fprintf(stderr, "Error - %s: workers should be a list of brick weights separated with commas\n", origin);
+        return SIM_ERROR_SYNTAX;
+    }
+
+    p->worker_count = count;
+    memcpy(p->worker_weights, weights, count * sizeof(size_t));
+    return SIM_OK;
+}
+
+// Sets a single parameter, used both by the config file and the command line
+// Only the syntax is checked here, ranges are checked all at once by sim_validate()
+sim_status_t _set_param(sim_params_t* p, const char* key, char* value, const char* origin) {
+    unsigned long number = 0;
+    sim_status_t status = SIM_OK;
+
+    if(strcmp(key, "max_bricks_count") == 0) {
+        status = _parse_value(value, ULONG_MAX, &number, key, origin);
+        p->max_bricks_count = number;
+    } else if(strcmp(key, "max_bricks_mass") == 0) {
+        status = _parse_value(value, ULONG_MAX, &number, key, origin);
+        p->max_bricks_mass = number;
+    } else if(strcmp(key, "truck_capacity") == 0) {
+        status = _parse_value(value, ULONG_MAX, &number, key, origin);
+        p->truck_capacity = number;
+    } else if(strcmp(key, "truck_count") == 0) {
+        status = _parse_value(value, ULONG_MAX, &number, key, origin);
+        p->truck_count = number;
+    } else if(strcmp(key, "truck_sleep_time") == 0) {
+        status = _parse_value(value, UINT_MAX, &number, key, origin);
+        p->truck_sleep_time = (unsigned int) number;
+    } else if(strcmp(key, "truck") == 0) {
+        status = _parse_fleet_line(p, value, origin);
+    } else if(strcmp(key, "fleet") == 0) {
+        status = sim_load_fleet(p, value);
+    } else if(strcmp(key, "workers") == 0) {
+        status = _parse_workers(p, value, origin);
+    } else if(strcmp(key, "dispatch") == 0) {
+        if(dispatch_parse_policy(value, &(p->dispatch_policy)) != 0) {
+            fprintf(stderr, "Error - %s: dispatch has to be \"fifo\" or \"mass\"\n", origin);
+            status = SIM_ERROR_SYNTAX;
+        }
+    } else if(strcmp(key, "runtime") == 0) {
+        if(strcmp(value, "threads") == 0 || strcmp(value, "epoll") == 0) {
+            p->use_event_loop = strcmp(value, "epoll") == 0;
+        } else {
+            fprintf(stderr, "Error - %s: runtime has to be \"threads\" or \"epoll\"\n", origin);
+            status = SIM_ERROR_SYNTAX;
+        }
+    } else if(strcmp(key, "samples_file") == 0) {
+        if(strlen(value) >= SIM_PATH_SIZE) {
+            fprintf(stderr, "Error - %s: samples file path is too long\n", origin);
+            status = SIM_ERROR_RANGE;
+        } else {
+            strcpy(p->samples_path, value);
+        }
+    } else if(strcmp(key, "sample_interval_ms") == 0) {
+        status = _parse_value(value, UINT_MAX, &number, key, origin);
+        p->sample_interval_ms = (unsigned int) number;
+    } else if(strcmp(key, "target_fill_percent") == 0) {
+        status = _parse_value(value, UINT_MAX, &number, key, origin);
+        p->target_fill_percent = (unsigned int) number;
+    } else if(strcmp(key, "stop_after_bricks") == 0) {
+        status = _parse_value(value, ULONG_MAX, &number, key, origin);
+        p->stop_after_bricks = number;
+    } else if(strcmp(key, "stop_after_seconds") == 0) {
+        status = _parse_value(value, UINT_MAX, &number, key, origin);
+        p->stop_after_seconds = (unsigned int) number;
+    } else {
+        fprintf(stderr, "Error - %s: unknown parameter \"%s\"\n", origin, key);
+        status = SIM_ERROR_USAGE;
+    }
+
+    return status;
+}
+
+sim_status_t sim_load_config(sim_params_t* p, const char* path) {
+    FILE* f = fopen(path, "r");
+    if(!f) {
+        int errno_tmp = errno;
+        fprintf(stderr, "Error opening config file \"%s\": %s\n", path, strerror(errno_tmp));
+        return SIM_ERROR_FILE;
+    }
+
+    char buffer[LINE_SIZE];
+    char origin[SIM_PATH_SIZE + 32];
+    size_t line_number = 0;
+    sim_status_t status = SIM_OK;
+    int result;
+
+    while(status == SIM_OK && (result = _read_line(f, buffer, &line_number)) != 0) {
+        snprintf(origin, sizeof(origin), "config file %s:%zu", path, line_number);
+
+        char* separator = strchr(buffer, '=');
+        if(result < 0) {
+            fprintf(stderr, "Error - %s: line too long\n", origin);
+            status = SIM_ERROR_SYNTAX;
+        } else if(separator == NULL) {
+            fprintf(stderr, "Error - %s: expected \"key = value\"\n", origin);
+            status = SIM_ERROR_SYNTAX;
+        } else {
+            *separator = '\0';
+            status = _set_param(p, _trim(buffer), _trim(separator + 1), origin);
+        }
+    }
+
+    fclose(f);
+    return status;
+}
+
+sim_status_t sim_validate(sim_params_t* p) {
+    sim_status_t status = SIM_OK;
+
+    if(p->max_bricks_count < SIM_MIN_BRICKS_COUNT || p->max_bricks_count > SIM_MAX_BRICKS_COUNT) {
+        fprintf(stderr, "Error - max_bricks_count (K) has to be in the range of <%d, %d>\n", SIM_MIN_BRICKS_COUNT, SIM_MAX_BRICKS_COUNT);
+        status = SIM_ERROR_RANGE;
+    } else if(p->max_bricks_mass < SIM_MIN_BRICKS_MASS || p->max_bricks_mass > 3 * p->max_bricks_count - 1) {
+        // 3K > M
+        fprintf(stderr, "Error - max_bricks_mass (M) has to be in the range of <%d, %zu>\n", SIM_MIN_BRICKS_MASS, 3 * p->max_bricks_count - 1);
+        status = SIM_ERROR_RANGE;
+    }
+
+    if(p->fleet_size > 0) {
+        // Either the whole fleet is described truck by truck, or all trucks are the same
+        if(p->truck_capacity != 0 || p->truck_sleep_time != 0 || (p->truck_count != 0 && p->truck_count != p->fleet_size)) {
+            fprintf(stderr, "Error - fleet cannot be combined with truck_capacity, truck_count and truck_sleep_time\n");
+            return SIM_ERROR_USAGE;
+        }
+        p->truck_count = p->fleet_size;
+    } else if(p->truck_capacity < SIM_MIN_TRUCK_CAPACITY || p->truck_capacity > SIM_MAX_TRUCK_CAPACITY) {
+        fprintf(stderr, "Error - truck_capacity (C) has to be in the range of <%d, %d>\n", SIM_MIN_TRUCK_CAPACITY, SIM_MAX_TRUCK_CAPACITY);
+        status = SIM_ERROR_RANGE;
+    } else if(p->truck_count == 0 || p->truck_count > SIM_MAX_TRUCKS) {
+        fprintf(stderr, "Error - truck_count (N) has to be in the range of <1, %d>\n", SIM_MAX_TRUCKS);
+        status = SIM_ERROR_RANGE;
+    } else if(p->truck_sleep_time == 0 || p->truck_sleep_time > SIM_MAX_TRUCK_SLEEP_TIME) {
+        fprintf(stderr, "Error - truck_sleep_time (Ti) has to be in the range of <1, %d>\n", SIM_MAX_TRUCK_SLEEP_TIME);
+        status = SIM_ERROR_RANGE;
+    } else {
+        // All trucks are the same
+        for(size_t i = 0; i < p->truck_count; i++) {
+            p->fleet[i].capacity = p->truck_capacity;
+            p->fleet[i].sleep_time = p->truck_sleep_time;
+        }
+    }
+
+    // Every brick has to fit both on the conveyor and in every truck, otherwise the simulation gets stuck
+    size_t smallest_capacity = SIM_MAX_TRUCK_CAPACITY;
+    for(size_t i = 0; status == SIM_OK && i < p->truck_count; i++) {
+        if(p->fleet[i].capacity < smallest_capacity) {
+            smallest_capacity = p->fleet[i].capacity;
+        }
+    }
+
+    if(p->worker_count == 0 || p->worker_count > SIM_MAX_WORKERS) {
+        fprintf(stderr, "Error - number of workers has to be in the range of <1, %d>\n", SIM_MAX_WORKERS);
+        status = SIM_ERROR_RANGE;
+    }
+    for(size_t i = 0; i < p->worker_count && i < SIM_MAX_WORKERS; i++) {
+        size_t weight = p->worker_weights[i];
+        if(weight == 0 || weight > SIM_MAX_BRICK_WEIGHT) {
+            fprintf(stderr, "Error - brick weight of worker %zu has to be in the range of <1, %d>\n", i + 1, SIM_MAX_BRICK_WEIGHT);
+            status = SIM_ERROR_RANGE;
+        } else if(status == SIM_OK && (weight > p->max_bricks_mass || weight > smallest_capacity)) {
+            fprintf(stderr, "Error - brick weight of worker %zu has to fit on the conveyor (M) and in every truck (C)\n", i + 1);
+            status = SIM_ERROR_RANGE;
+        }
+    }
+
+    if(p->sample_interval_ms == 0 || p->sample_interval_ms > SIM_MAX_SAMPLE_INTERVAL_MS) {
+        fprintf(stderr, "Error - sample_interval_ms has to be in the range of <1, %d>\n", SIM_MAX_SAMPLE_INTERVAL_MS);
+        status = SIM_ERROR_RANGE;
+    }
+
+    if(p->target_fill_percent > 100) {
+        fprintf(stderr, "Error - target_fill_percent has to be in the range of <1, 100>, or 0 to disable pacing\n");
+        status = SIM_ERROR_RANGE;
+    } else if(p->target_fill_percent > 0 && p->use_event_loop) {
+        // Event loop never blocks on a full conveyor, so there is nothing to pace
+        fprintf(stderr, "Error - worker pacing is only available with the threads runtime\n");
+        return SIM_ERROR_USAGE;
+    }
+
+    return status;
+}
+
+void sim_print_usage(const char* name) {
+    fprintf(stderr, "Usage: %s [-c config_file] [options]\n", name);
+    fprintf(stderr, "Options override the values from the config file given before them:\n");
+    fprintf(stderr, "  -K count        maximum number of bricks on the conveyor (max_bricks_count)\n");
+    fprintf(stderr, "  -M mass         maximum mass of bricks on the conveyor (max_bricks_mass)\n");
+    fprintf(stderr, "  -C capacity     capacity of every truck (truck_capacity)\n");
+    fprintf(stderr, "  -N count        number of trucks (truck_count)\n");
+    fprintf(stderr, "  -T seconds      delivery time of every truck (truck_sleep_time)\n");
+    fprintf(stderr, "  -f fleet_file   trucks described one by one, instead of -C, -N and -T (fleet)\n");
+    fprintf(stderr, "  -w w1,w2,...    brick weights of the workers, default 1,2,3 (workers)\n");
+    fprintf(stderr, "  -d fifo|mass    dispatch policy (dispatch)\n");
+    fprintf(stderr, "  -r threads|epoll runtime (runtime)\n");
+    fprintf(stderr, "  -o file         write occupancy samples to the file (samples_file)\n");
+    fprintf(stderr, "  -i ms           sampling interval, default 100 (sample_interval_ms)\n");
+    fprintf(stderr, "  -p percent      pace workers to keep the conveyor at the target fill (target_fill_percent)\n");
+    fprintf(stderr, "  -b count        stop the production after that many bricks (stop_after_bricks)\n");
+    fprintf(stderr, "  -t seconds      stop the production after that many seconds (stop_after_seconds)\n");
+    fprintf(stderr, "Without -c, -K, -M, -C, -N and -T the parameters are read from standard input\n");
+}
+
+sim_status_t sim_parse_args(sim_params_t* p, int argc, char** argv) {
+    // Build the getopt string from the table of options, all of them take an argument
+    char optstring[2 * SIM_NUM_OPTIONS + 3] = "c:";
+    for(size_t i = 0; i < SIM_NUM_OPTIONS; i++) {
+        optstring[2 * i + 2] = _sim_options[i].option;
+        optstring[2 * i + 3] = ':';
+    }
+    optstring[2 * SIM_NUM_OPTIONS + 2] = '\0';
+
+    // Parameters of the conveyor or trucks given in any way - otherwise ask the user
+    int configured = 0;
+    sim_status_t status = SIM_OK;
+
+    int opt;
+    while(status == SIM_OK && (opt = getopt(argc, argv, optstring)) != -1) {
+        if(opt == 'c') {
+            status = sim_load_config(p, optarg);
+            configured = 1;
+            continue;
+        }
+
+        const char* key = NULL;
+        for(size_t i = 0; i < SIM_NUM_OPTIONS; i++) {
+            if(_sim_options[i].option == opt) {
+                key = _sim_options[i].key;
+            }
+        }
+
+        if(key == NULL) {
+            sim_print_usage(argv[0]);
+            return SIM_ERROR_USAGE;
+        }
+
+        char origin[8];
+        snprintf(origin, sizeof(origin), "-%c", opt);
+        status = _set_param(p, key, optarg, origin);
+        configured = configured || strchr("KMCNT", opt) != NULL;
+    }
+
+    if(status != SIM_OK) {
+        return status;
+    }
+
+    if(optind < argc) {
+        sim_print_usage(argv[0]);
+        return SIM_ERROR_USAGE;
+    }
+
+    if(!configured && (status = sim_query_user_for_params(p)) != SIM_OK) {
+        return status;
+    }
+
+    if((status = sim_validate(p)) != SIM_OK) {
+        return status;
+    }
+
+    _print_summary(p);
+    return SIM_OK;
 }
@@ -2,6 +2,36 @@
 #define _SIM_H_
 
 #include <stddef.h>
+#include <stdint.h>
+
+#include "dispatch.h"
+
+// Upper limit for the number of trucks described in a fleet file
+#define SIM_MAX_TRUCKS 64
+
+// Upper limit for the number of workers
+#define SIM_MAX_WORKERS 16
+
+// Maximum length of paths stored in the parameters
+#define SIM_PATH_SIZE 256
+
+// Result of loading the parameters, also used as the exit code of the program
+enum sim_status_t {
+    SIM_OK = 0,
+    SIM_ERROR_USAGE = 1, // Unknown option or key, conflicting options
+    SIM_ERROR_SYNTAX = 2, // Value that cannot be parsed
+    SIM_ERROR_RANGE = 3, // Value outside of the allowed range
+    SIM_ERROR_FILE = 4, // Config or fleet file cannot be read
+    SIM_ERROR_RUNTIME = 5, // Not a configuration error - failure while starting or running the simulation
+};
+typedef enum sim_status_t sim_status_t;
+
+// Description of a single truck of the fleet
+struct sim_truck_spec_t {
+    size_t capacity; // C in task description
+    unsigned int sleep_time; // Ti in task description
+};
+typedef struct sim_truck_spec_t sim_truck_spec_t;
 
 struct sim_params_t {
     size_t max_bricks_count; // K in task description
@@ -9,13 +39,65 @@ struct sim_params_t {
     size_t truck_capacity; // C in task description
     size_t truck_count; // N in task description
     unsigned int truck_sleep_time; // Ti in task description
+
+    // Per-truck parameters, first truck_count entries are used
+    // Either all equal to truck_capacity and truck_sleep_time, or loaded from a fleet file
+    sim_truck_spec_t fleet[SIM_MAX_TRUCKS];
+
+    // Number of trucks described one by one (fleet file or "truck" keys), 0 if the fleet is uniform
+    size_t fleet_size;
+
+    // Weights of bricks produced by the workers, worker i + 1 produces bricks of worker_weights[i]
+    size_t worker_count;
+    size_t worker_weights[SIM_MAX_WORKERS];
+
+    // How the next truck for the conveyor is chosen
+    dispatch_policy_t dispatch_policy;
+
+    // Runtime used for the simulation - thread per entity or the single-threaded event loop
+    int use_event_loop;
+
+    // Occupancy sampler, disabled if the path is empty
+    char samples_path[SIM_PATH_SIZE];
+    unsigned int sample_interval_ms;
+
+    // Worker pacing target, in percent of M, 0 if disabled
+    unsigned int target_fill_percent;
+
+    // Bounded run - stop the production after that many bricks or seconds, 0 if unlimited
+    uint64_t stop_after_bricks;
+    unsigned int stop_after_seconds;
 };
 typedef struct sim_params_t sim_params_t;
 
+// Fill the structure with default values (workers producing 1, 2 and 3, no optional features)
+void sim_params_init(sim_params_t*);
+
+// Load all parameters from the command line (see sim_print_usage())
+// Without any conveyor or fleet parameters given, falls back to asking the user on standard input
+// Everything is validated with sim_validate() before returning
+sim_status_t sim_parse_args(sim_params_t*, int, char**);
+
+// Load the parameters from a config file, one "key = value" per line
+// Keys are named after the fields of sim_params_t, plus "workers" (weights separated with commas),
+// "fleet" (path of a fleet file) and "truck" (a single line of a fleet file)
+// Empty lines and everything after '#' are ignored
+sim_status_t sim_load_config(sim_params_t*, const char*);
+
+// Load the fleet from a file, one line per group of identical trucks:
+//   capacity sleep_time [count]
+// Empty lines and everything after '#' are ignored
+sim_status_t sim_load_fleet(sim_params_t*, const char*);
+
 // Ask user about parameters to be used, store them in the structure
-void sim_query_user_for_params(sim_params_t*);
+// If the fleet was already loaded, user is only asked about the conveyor
+sim_status_t sim_query_user_for_params(sim_params_t*);
+
+// Check all parameters and their relations, printing every problem found
+// Expands a uniform fleet into the fleet array
+sim_status_t sim_validate(sim_params_t*);
 
-// Hardcoded in task description
-#define SIM_NUM_WORKERS 3
+// Print the command line options
+void sim_print_usage(const char*);
 
 #endif
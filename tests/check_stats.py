@@ -25,21 +25,25 @@ for removal in all_removal_events:
     truck_dict_removals[truck_id]['total_count'] += 1
     truck_dict_removals[truck_id]['total_mass'] += brick_size
 
-worker_dict_insertions = {
-    1: 0,
-    2: 0,
-    3: 0
-}
+all_workers_start_events = re.finditer(r'\[P([0-9]+)\] Worker started with data: \{ weight: ([0-9]+)', log)
+worker_dict_insertions = {}
+for w in all_workers_start_events:
+    idx = int(w.group(1))
+    worker_dict_insertions[idx] = {
+        'weight': int(w.group(2)),
+        'total_count': 0
+    }
 
 all_insertion_events = re.finditer(r'EVENT_WORKER_INSERT\(([0-9]+)\)', log)
 for insertion in all_insertion_events:
     worker_id = int(insertion.group(1))
-    worker_dict_insertions[worker_id] += 1 # same as weight
+    worker_dict_insertions[worker_id]['total_count'] += 1
 
 sum_inserted_bricks = 0
 for worker in worker_dict_insertions:
-    worker_sum = worker_dict_insertions[worker]*worker
-    print(f"Worker with id {worker} has put {worker_dict_insertions[worker]} bricks on the conveyor. The total mass is {worker_sum}" )
+    worker_count = worker_dict_insertions[worker]['total_count']
+    worker_sum = worker_count*worker_dict_insertions[worker]['weight']
+    print(f"Worker with id {worker} has put {worker_count} bricks on the conveyor. The total mass is {worker_sum}" )
     sum_inserted_bricks += worker_sum
 print("\n")
 sum_received_bricks = 0
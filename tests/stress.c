@@ -0,0 +1,375 @@
+// Stress test of the conveyor structure
+// Many producers and consumers use the conveyor without any sleeps, with randomized
+// conveyor limits, brick weights and truck capacities, while invariants are checked in-process:
+//  - K and M are never exceeded (checked after every operation through conveyor_snapshot())
+//  - bricks leave the conveyor in the order they were inserted (sequence numbers in the bricks)
+//  - no brick is lost or duplicated and the total mass is conserved (per-thread counters)
+// Built by scripts/build_stress.sh, which needs CONVEYOR_TRACE_BRICKS and CONVEYOR_NO_LOG defined
+#include "conveyor.h"
+#include "dispatch.h"
+#include "worker.h"
+
+#include <pthread.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef CONVEYOR_TRACE_BRICKS
+#error "stress test has to be built with CONVEYOR_TRACE_BRICKS defined"
+#endif
+
+#define STRESS_MAX_PRODUCERS 64
+#define STRESS_MAX_CONSUMERS 64
+
+// Only the first few failures are printed, all of them are counted
+#define STRESS_MAX_REPORTED_FAILURES 10
+
+struct stress_params_t {
+    size_t producers;
+    size_t consumers;
+    size_t bricks_per_producer;
+    unsigned long rounds; // 0 means until killed (soak test)
+    unsigned int seed;
+};
+typedef struct stress_params_t stress_params_t;
+
+// State shared by all threads of a single round
+struct stress_round_t {
+    conveyor_t* conveyor;
+    size_t producers;
+    uint8_t weights[STRESS_MAX_PRODUCERS];
+
+    // Only touched by the truck holding the conveyor reservation - the handover of
+    // the reservation goes through the conveyor mutex, so no further synchronization is needed
+    uint32_t expected_order;
+    uint32_t expected_producer_seq[STRESS_MAX_PRODUCERS];
+};
+typedef struct stress_round_t stress_round_t;
+
+struct stress_producer_t {
+    stress_round_t* round;
+    uint16_t id;
+    size_t bricks;
+
+    // Per-thread counters, read by main after joining
+    uint64_t produced_count;
+    uint64_t produced_mass;
+
+    pthread_t thread_id;
+};
+typedef struct stress_producer_t stress_producer_t;
+
+struct stress_consumer_t {
+    stress_round_t* round;
+    int id;
+    size_t capacity;
+
+    uint64_t consumed_count;
+    uint64_t consumed_mass;
+    uint64_t trips;
+
+    pthread_t thread_id;
+};
+typedef struct stress_consumer_t stress_consumer_t;
+
+uint64_t _failures = 0;
+
+void _stress_fail(const char* format, ...) {
+    uint64_t failures = __atomic_fetch_add(&_failures, 1, __ATOMIC_RELAXED);
+    if(failures >= STRESS_MAX_REPORTED_FAILURES) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[STRESS] FAILURE: ");
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+// K and M hold for every counter on its own, so they can be checked without the mutex
+void _stress_check_bounds(conveyor_t* c) {
+    conveyor_snapshot_t snap;
+    conveyor_snapshot(c, &snap);
+
+    if(snap.bricks_count > c->max_bricks_count) {
+        _stress_fail("%zu bricks on the conveyor, limit is %zu", snap.bricks_count, c->max_bricks_count);
+    }
+    if(snap.bricks_mass > c->max_bricks_mass) {
+        _stress_fail("mass %zu on the conveyor, limit is %zu", snap.bricks_mass, c->max_bricks_mass);
+    }
+}
+
+void* _stress_producer_main(void* arg) {
+    stress_producer_t* p = (stress_producer_t*) arg;
+    conveyor_t* c = p->round->conveyor;
+    uint8_t weight = p->round->weights[p->id];
+
+    for(size_t i = 0; i < p->bricks; i++) {
+        brick_t brick = { .mass = weight, .producer = p->id, .producer_seq = (uint32_t) i };
+
+        if(!conveyor_insert_brick(c, brick)) {
+            _stress_fail("producer %u could not insert brick %zu", p->id, i);
+            break;
+        }
+
+        p->produced_count++;
+        p->produced_mass += weight;
+        _stress_check_bounds(c);
+    }
+
+    return NULL;
+}
+
+// Checks a brick received by the truck holding the reservation
+void _stress_check_brick(stress_round_t* r, stress_consumer_t* t, brick_t brick) {
+    if(brick.order != r->expected_order) {
+        _stress_fail("truck %d received brick number %u, expected %u", t->id, brick.order, r->expected_order);
+    }
+    r->expected_order = brick.order + 1;
+
+    if(brick.producer >= r->producers) {
+        _stress_fail("truck %d received brick of unknown producer %u", t->id, brick.producer);
+        return;
+    }
+
+    if(brick.mass != r->weights[brick.producer]) {
+        _stress_fail("brick of producer %u has mass %u, expected %u", brick.producer, brick.mass, r->weights[brick.producer]);
+    }
+
+    uint32_t* expected_seq = &(r->expected_producer_seq[brick.producer]);
+    if(brick.producer_seq != *expected_seq) {
+        _stress_fail("truck %d received brick %u of producer %u, expected %u", t->id, brick.producer_seq, brick.producer, *expected_seq);
+    }
+    *expected_seq = brick.producer_seq + 1;
+}
+
+void* _stress_consumer_main(void* arg) {
+    stress_consumer_t* t = (stress_consumer_t*) arg;
+    stress_round_t* r = t->round;
+    conveyor_t* c = r->conveyor;
+
+    dispatch_candidate_t candidate = { .id = t->id, .capacity = t->capacity, .delivery_time = 1 };
+
+    while(!conveyor_end_of_bricks(c)) {
+        conveyor_truck_reserve(c, &candidate);
+
+        size_t load = 0;
+        while(1) {
+            brick_t brick = conveyor_remove_brick(c, t->capacity - load);
+            if(brick.mass == 0) {
+                break;
+            }
+
+            _stress_check_brick(r, t, brick);
+            load += brick.mass;
+            t->consumed_count++;
+            t->consumed_mass += brick.mass;
+            _stress_check_bounds(c);
+        }
+
+        if(load > t->capacity) {
+            _stress_fail("truck %d loaded %zu, capacity is %zu", t->id, load, t->capacity);
+        }
+
+        conveyor_truck_leave(c, t->id);
+        t->trips++;
+    }
+
+    return NULL;
+}
+
+// Random number in the range of <min, max>
+size_t _stress_random(unsigned int* seed, size_t min, size_t max) {
+    return min + (size_t) rand_r(seed) % (max - min + 1);
+}
+
+// Runs a single round with randomized parameters, returns 0 if it could not be started
+int _stress_run_round(stress_params_t* params, unsigned long round_number, unsigned int* seed) {
+    stress_round_t r;
+    memset(&r, 0, sizeof(r));
+    r.producers = params->producers;
+
+    // Small conveyors force a lot of waiting on both sides, big ones let the threads run ahead
+    size_t max_bricks_count = _stress_random(seed, 3, 200);
+    size_t max_bricks_mass = _stress_random(seed, 6, 3 * max_bricks_count - 1);
+    for(size_t i = 0; i < params->producers; i++) {
+        r.weights[i] = (uint8_t) _stress_random(seed, 1, 3);
+    }
+
+    dispatch_policy_t policy = round_number % 2 == 0 ? DISPATCH_FIFO : DISPATCH_MASS_RATE;
+    dispatch_t* dispatch = dispatch_init(policy, params->consumers);
+    if(!dispatch) {
+        return 0;
+    }
+
+    r.conveyor = conveyor_init(max_bricks_count, max_bricks_mass, dispatch);
+    if(!r.conveyor) {
+        dispatch_destroy(dispatch);
+        return 0;
+    }
+
+    worker_stop_flag_clear();
+
+    stress_producer_t producers[params->producers];
+    stress_consumer_t consumers[params->consumers];
+    memset(producers, 0, sizeof(producers));
+    memset(consumers, 0, sizeof(consumers));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for(size_t i = 0; i < params->consumers; i++) {
+        consumers[i].round = &r;
+        consumers[i].id = (int) i + 1;
+        consumers[i].capacity = _stress_random(seed, 3, 60);
+        if(pthread_create(&(consumers[i].thread_id), NULL, &_stress_consumer_main, &(consumers[i])) != 0) {
+            fprintf(stderr, "Error while starting consumer %zu\n", i + 1);
+            exit(2);
+        }
+    }
+
+    for(size_t i = 0; i < params->producers; i++) {
+        producers[i].round = &r;
+        producers[i].id = (uint16_t) i;
+        producers[i].bricks = params->bricks_per_producer;
+        if(pthread_create(&(producers[i].thread_id), NULL, &_stress_producer_main, &(producers[i])) != 0) {
+            fprintf(stderr, "Error while starting producer %zu\n", i);
+            exit(2);
+        }
+    }
+
+    uint64_t produced_count = 0, produced_mass = 0;
+    for(size_t i = 0; i < params->producers; i++) {
+        pthread_join(producers[i].thread_id, NULL);
+        produced_count += producers[i].produced_count;
+        produced_mass += producers[i].produced_mass;
+    }
+
+    // End of production - trucks take the rest of the bricks and finish
+    worker_stop_flag_set();
+    conveyor_wake_all(r.conveyor);
+
+    uint64_t consumed_count = 0, consumed_mass = 0, trips = 0;
+    for(size_t i = 0; i < params->consumers; i++) {
+        pthread_join(consumers[i].thread_id, NULL);
+        consumed_count += consumers[i].consumed_count;
+        consumed_mass += consumers[i].consumed_mass;
+        trips += consumers[i].trips;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    // Mass conservation - per-thread counters, conveyor counters and the sequence numbers have to agree
+    conveyor_snapshot_t snap;
+    conveyor_snapshot(r.conveyor, &snap);
+
+    if(produced_count != params->producers * params->bricks_per_producer) {
+        _stress_fail("produced %llu bricks, expected %zu", (unsigned long long) produced_count, params->producers * params->bricks_per_producer);
+    }
+    if(consumed_count != produced_count || consumed_mass != produced_mass) {
+        _stress_fail("produced %llu bricks of mass %llu, consumed %llu bricks of mass %llu",
+            (unsigned long long) produced_count, (unsigned long long) produced_mass,
+            (unsigned long long) consumed_count, (unsigned long long) consumed_mass);
+    }
+    if(snap.total_inserted_mass != produced_mass || snap.total_removed_mass != consumed_mass) {
+        _stress_fail("conveyor counted inserted mass %llu and removed mass %llu",
+            (unsigned long long) snap.total_inserted_mass, (unsigned long long) snap.total_removed_mass);
+    }
+    if(snap.bricks_count != 0 || snap.bricks_mass != 0) {
+        _stress_fail("%zu bricks of mass %zu left on the conveyor", snap.bricks_count, snap.bricks_mass);
+    }
+    if(r.expected_order != produced_count) {
+        _stress_fail("last brick number is %u, expected %llu", r.expected_order, (unsigned long long) produced_count);
+    }
+    for(size_t i = 0; i < params->producers; i++) {
+        if(r.expected_producer_seq[i] != producers[i].produced_count) {
+            _stress_fail("received %u bricks of producer %zu, it produced %llu", r.expected_producer_seq[i], i, (unsigned long long) producers[i].produced_count);
+        }
+    }
+
+    double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    printf("[STRESS] round %lu: K=%zu M=%zu dispatch=%s bricks=%llu mass=%llu trips=%llu waits=%llu %.3fs (%.0f bricks/s) %s\n",
+        round_number, max_bricks_count, max_bricks_mass, policy == DISPATCH_FIFO ? "fifo" : "mass",
+        (unsigned long long) consumed_count, (unsigned long long) consumed_mass, (unsigned long long) trips,
+        (unsigned long long) snap.total_space_waits, elapsed, elapsed > 0 ? consumed_count / elapsed : 0.0,
+        __atomic_load_n(&_failures, __ATOMIC_RELAXED) == 0 ? "OK" : "FAILED");
+    fflush(stdout);
+
+    conveyor_destroy(r.conveyor);
+    dispatch_destroy(dispatch);
+    return 1;
+}
+
+// Parses a number option in the range of <min, max>, exits on error
+unsigned long _stress_parse(const char* text, unsigned long min, unsigned long max, char option) {
+    char* endptr = (char*) text;
+    unsigned long value = strtoul(text, &endptr, 10);
+
+    if(endptr == text || *endptr != '\0' || value < min || value > max) {
+        fprintf(stderr, "Error - value of -%c has to be in the range of <%lu, %lu>\n", option, min, max);
+        exit(1);
+    }
+
+    return value;
+}
+
+int main(int argc, char** argv) {
+    stress_params_t params = {
+        .producers = 8,
+        .consumers = 8,
+        .bricks_per_producer = 100000,
+        .rounds = 10,
+        .seed = (unsigned int) time(NULL),
+    };
+
+    int opt;
+    while((opt = getopt(argc, argv, "p:c:n:r:s:")) != -1) {
+        switch(opt) {
+            case 'p':
+                params.producers = _stress_parse(optarg, 1, STRESS_MAX_PRODUCERS, opt);
+                break;
+            case 'c':
+                params.consumers = _stress_parse(optarg, 1, STRESS_MAX_CONSUMERS, opt);
+                break;
+            case 'n':
+                params.bricks_per_producer = _stress_parse(optarg, 1, UINT32_MAX / STRESS_MAX_PRODUCERS, opt);
+                break;
+            case 'r':
+                params.rounds = _stress_parse(optarg, 0, ULONG_MAX, opt);
+                break;
+            case 's':
+                params.seed = (unsigned int) _stress_parse(optarg, 0, UINT32_MAX, opt);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-p producers] [-c consumers] [-n bricks_per_producer] [-r rounds, 0 = until killed] [-s seed]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    // Seed is printed so that a failing run can be repeated
+    printf("[STRESS] producers=%zu consumers=%zu bricks_per_producer=%zu rounds=%lu seed=%u\n",
+        params.producers, params.consumers, params.bricks_per_producer, params.rounds, params.seed);
+
+    unsigned int seed = params.seed;
+    for(unsigned long round = 1; params.rounds == 0 || round <= params.rounds; round++) {
+        if(!_stress_run_round(&params, round, &seed)) {
+            fprintf(stderr, "Error while creating the conveyor\n");
+            return 2;
+        }
+
+        if(__atomic_load_n(&_failures, __ATOMIC_RELAXED) > 0) {
+            break;
+        }
+    }
+
+    uint64_t failures = __atomic_load_n(&_failures, __ATOMIC_RELAXED);
+    printf("[STRESS] %s (%llu failures)\n", failures == 0 ? "PASSED" : "FAILED", (unsigned long long) failures);
+    return failures == 0 ? 0 : 1;
+}
@@ -20,6 +20,8 @@ truck_t* truck_init(int id, size_t max_capacity, unsigned int sleep_time, convey
     t->max_capacity = max_capacity;
     t->current_capacity = max_capacity; // truck starts empty
     t->sleep_time = sleep_time;
+    t->trips = 0;
+    t->delivered_mass = 0;
     t->conveyor = c;
 
     return t;
@@ -46,6 +48,30 @@ int truck_start(truck_t* t) {
     return 1;
 }
 
+void truck_fill_candidate(truck_t* t, dispatch_candidate_t* candidate) {
+    candidate->id = t->id;
+    candidate->capacity = t->max_capacity;
+    candidate->delivery_time = t->sleep_time;
+}
+
+void truck_deliver(truck_t* t) {
+    size_t load = t->max_capacity - t->current_capacity;
+
+    // Leaving empty (end of bricks) is not a delivery
+    if(load > 0) {
+        t->trips++;
+        t->delivered_mass += load;
+        printf("[C%d] EVENT_TRUCK_DELIVERY(%d,%zu) Truck delivering %zu/%zu\n", t->id, t->id, load, load, t->max_capacity);
+    }
+
+    t->current_capacity = t->max_capacity;
+}
+
+void truck_print_stats(truck_t* t) {
+    printf("[C%d] EVENT_TRUCK_STATS(%d) deliveries: %zu, delivered mass: %zu, average load: %.1f/%zu\n", t->id, t->id, t->trips, t->delivered_mass,
+        t->trips > 0 ? (double) t->delivered_mass / t->trips : 0.0, t->max_capacity);
+}
+
 void* _truck_main(void* arg) {
     truck_t* t = (truck_t*) arg;
 
@@ -58,11 +84,14 @@ void* _truck_main(void* arg) {
 
     printf("[C%d] EVENT_TRUCK_START(%d) with data: { max_capacity: %zu, sleep_time: %ds, conveyor reference: %p }\n", id, id, max_capacity, sleep_time, (void*) c);
 
+    dispatch_candidate_t candidate;
+    truck_fill_candidate(t, &candidate);
+
     // Reserving-leaving loop
     // Exit once no more bricks
     while(!conveyor_end_of_bricks(c)) {
         // Wait to reserve the conveyor for loading
-        conveyor_truck_reserve(c, id);
+        conveyor_truck_reserve(c, &candidate);
 
         printf("[C%d] Truck reserved the conveyor access - loading\n", id);
 
@@ -98,11 +127,12 @@ void* _truck_main(void* arg) {
         conveyor_truck_leave(c, id);
 
         // Delivering bricks
+        truck_deliver(t);
         sleep(sleep_time);
-        t->current_capacity = max_capacity;
     }
 
     printf("[C%d] Truck finishing work, due to no more bricks\n", id);
+    truck_print_stats(t);
 
     pthread_exit(NULL);
 }
@@ -18,6 +18,10 @@ struct truck_t {
     // Sleeping time (in seconds)
     unsigned int sleep_time;
 
+    // Statistics - number of deliveries and total mass delivered
+    size_t trips;
+    size_t delivered_mass;
+
     // Reference to the conveyor structure
     conveyor_t* conveyor;
 
@@ -35,4 +39,14 @@ truck_t* truck_init(int, size_t, unsigned int, conveyor_t*);
 // Returns 0 in case of error
 int truck_start(truck_t*);
 
+// Describe the truck for the dispatcher, when it is waiting for the conveyor
+void truck_fill_candidate(truck_t*, dispatch_candidate_t*);
+
+// Account the current load as delivered and empty the truck
+// Used when the truck leaves the conveyor, prints the delivery event
+void truck_deliver(truck_t*);
+
+// Print the statistics of the truck once it finished work
+void truck_print_stats(truck_t*);
+
 #endif
@@ -14,11 +14,15 @@ void* _worker_main(void*);
 int _stop_flag = 0;
 
 void worker_stop_flag_set() {
-    _stop_flag = 1;
+    __atomic_store_n(&_stop_flag, 1, __ATOMIC_RELEASE);
 }
 
 int worker_stop_flag_is_set() {
-    return _stop_flag;
+    return __atomic_load_n(&_stop_flag, __ATOMIC_ACQUIRE);
+}
+
+void worker_stop_flag_clear() {
+    __atomic_store_n(&_stop_flag, 0, __ATOMIC_RELEASE);
 }
 
 worker_t* worker_init(int id, size_t weight, conveyor_t* c) {
@@ -31,6 +35,7 @@ worker_t* worker_init(int id, size_t weight, conveyor_t* c) {
     w->id = id;
     w->produced_brick_weight = weight;
     w->conveyor = c;
+    w->rate_control = NULL;
 
     return w;
 }
@@ -65,17 +70,29 @@ void* _worker_main(void* arg) {
     int id = w->id;
     size_t weight = w->produced_brick_weight;
 
+    ratectl_t* rate_control = w->rate_control;
+
     printf("[P%d] Worker started with data: { weight: %zu, conveyor reference: %p }\n", id, weight, (void*) c);
 
+    ratectl_state_t pace;
+    if(rate_control) {
+        ratectl_state_init(rate_control, &pace);
+    }
+
     while(!worker_stop_flag_is_set()) {
+        // Wait for our slot instead of blocking on a full conveyor
+        if(rate_control) {
+            ratectl_pace(rate_control, &pace);
+        }
+
         // Create new brick
         brick_t new_brick = { .mass = weight };
 
         printf("[P%d] trying to insert brick of weight %zu into the conveyor\n", id, weight);
-        // Try to insert it
-        conveyor_insert_brick(c, new_brick);
-
-        printf("[P%d] EVENT_WORKER_INSERT(%d) Succesfully inserted brick of weight %zu into the conveyor\n", id, id, weight);
+        // Try to insert it - it is refused only when the production is over
+        if(conveyor_insert_brick(c, new_brick)) {
+            printf("[P%d] EVENT_WORKER_INSERT(%d) Succesfully inserted brick of weight %zu into the conveyor\n", id, id, weight);
+        }
     };
 
     printf("[P%d] Worker saw stop_flag set to 1, finishing work\n", id);
@@ -5,13 +5,18 @@
 #include <pthread.h>
 
 #include "conveyor.h"
+#include "ratectl.h"
 
 // These functions check global flag shared between threads
-// Only the main thread will write to the flag, others will only read it
-// in this case, synchronization is not critical to proper execution of the program
+// The flag is set by the main thread (or the conveyor, once the brick limit is reached), others only read it
+// Accesses are atomic, so that the flag can be read without holding the conveyor mutex
 void worker_stop_flag_set();
 int worker_stop_flag_is_set();
 
+// Lowers the flag again - only for running several simulations in one process (stress test),
+// when no worker or truck thread is running
+void worker_stop_flag_clear();
+
 struct worker_t {
     // worker id
     int id;
@@ -22,6 +27,10 @@ struct worker_t {
     // Reference to the conveyor structure
     conveyor_t* conveyor;
 
+    // Optional controller pacing the production, NULL if worker produces as fast as possible
+    // Can be set after worker_init(), before worker_start()
+    ratectl_t* rate_control;
+
     // Worker thread
     pthread_t thread_id;
 };